@@ -0,0 +1,86 @@
+#ifndef _AlignedBuffer_H
+#define _AlignedBuffer_H
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+/// Fixed-size, zero-initialized array whose storage starts on a cache line
+/// boundary. Used for the grids that the diffusion kernels stream over, so
+/// that every row can be loaded with aligned vector instructions.
+template <typename T>
+class AlignedBuffer {
+    T * data_ptr;
+    size_t num_elements;
+
+    public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    AlignedBuffer() : data_ptr(nullptr), num_elements(0) {;}
+
+    explicit AlignedBuffer(size_t n) : data_ptr(nullptr), num_elements(0) {
+        Resize(n);
+    }
+
+    AlignedBuffer(const AlignedBuffer & other) : data_ptr(nullptr), num_elements(0) {
+        Resize(other.num_elements);
+        if (num_elements) {
+            std::memcpy(data_ptr, other.data_ptr, num_elements * sizeof(T));
+        }
+    }
+
+    AlignedBuffer(AlignedBuffer && other) noexcept
+        : data_ptr(other.data_ptr), num_elements(other.num_elements) {
+        other.data_ptr = nullptr;
+        other.num_elements = 0;
+    }
+
+    AlignedBuffer & operator=(AlignedBuffer other) {
+        Swap(other);
+        return *this;
+    }
+
+    ~AlignedBuffer() {
+        std::free(data_ptr);
+    }
+
+    /// Discard the current contents and allocate @param n zeroed elements.
+    void Resize(size_t n) {
+        std::free(data_ptr);
+        data_ptr = nullptr;
+        num_elements = n;
+        if (n == 0) {
+            return;
+        }
+
+        // aligned_alloc requires the size to be a multiple of the alignment
+        size_t bytes = ((n * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+        data_ptr = static_cast<T*>(std::aligned_alloc(ALIGNMENT, bytes));
+        if (!data_ptr) {
+            throw std::bad_alloc();
+        }
+        std::memset(data_ptr, 0, bytes);
+    }
+
+    /// Exchange storage with @param other without copying any elements
+    void Swap(AlignedBuffer & other) noexcept {
+        std::swap(data_ptr, other.data_ptr);
+        std::swap(num_elements, other.num_elements);
+    }
+
+    void Fill(const T & val) {
+        for (size_t i = 0; i < num_elements; i++) {
+            data_ptr[i] = val;
+        }
+    }
+
+    size_t size() const {return num_elements;}
+    T * data() {return data_ptr;}
+    const T * data() const {return data_ptr;}
+
+    T & operator[](size_t i) {return data_ptr[i];}
+    const T & operator[](size_t i) const {return data_ptr[i];}
+};
+
+#endif
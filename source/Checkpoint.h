@@ -0,0 +1,280 @@
+#ifndef _Checkpoint_H
+#define _Checkpoint_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Complete state of a run between two updates: the public good grids
+/// (and those of any EXTRA_FIELDS), every cell and the random number
+/// generator, plus the row state of STEADY_STATE if the run keeps it.
+/// Fields and cell arrays are unpadded and indexed by cell id (x fastest),
+/// whatever the engine.
+///
+/// On disk this is a fixed header followed by the arrays in the order
+/// below, in native byte order. It is meant for restarting a run on the
+/// same machine and build, not for long-term storage. Version 1 files,
+/// from before extra fields, and version 2 files, from before the
+/// STEADY_STATE row state, are still read.
+struct Checkpoint {
+    static constexpr char MAGIC[8] = {'H', 'C', 'A', 'C', 'K', 'P', 'T', '\0'};
+    static constexpr uint32_t VERSION = 3;
+
+    uint64_t x_len = 0;
+    uint64_t y_len = 0;
+    uint64_t z_len = 0;
+    uint64_t update = 0;
+    uint64_t extra_fields = 0;
+    std::vector<unsigned char> random_state; // Raw bytes of the emp::Random
+
+    std::vector<double> curr_field;
+    std::vector<double> next_field; // Pending sources on the fused path
+    std::vector<unsigned char> occupied;
+    std::vector<unsigned char> producer;
+    std::vector<int32_t> age;
+    std::vector<double> resistance;
+    std::vector<double> extra_curr_field; // Field after field, extra_fields of them
+    std::vector<double> extra_next_field;
+    std::vector<unsigned char> steady_rows;  // Per row (y, then z), empty if not tracked; see ResourceGradient::SaveSteadyRows()
+    std::vector<unsigned char> steady_cells; // Per cell, masks the rows were last updated with
+
+    size_t GetSize() const {return (size_t)(x_len * y_len * z_len);}
+
+    /// Size all arrays for an @param x by @param y by @param z grid
+    void Resize(size_t x, size_t y, size_t z) {
+        x_len = x;
+        y_len = y;
+        z_len = z;
+        const size_t size = GetSize();
+        curr_field.assign(size, 0);
+        next_field.assign(size, 0);
+        occupied.assign(size, 0);
+        producer.assign(size, 0);
+        age.assign(size, 0);
+        resistance.assign(size, 0);
+        ResizeExtraFields(0);
+        ResizeSteadyRows(false);
+    }
+
+    /// Size the extra field arrays for @param n fields
+    void ResizeExtraFields(size_t n) {
+        extra_fields = n;
+        extra_curr_field.assign(n * GetSize(), 0);
+        extra_next_field.assign(n * GetSize(), 0);
+    }
+
+    /// Size the STEADY_STATE row state for a run that does (@param tracked)
+    /// or does not track it
+    void ResizeSteadyRows(bool tracked) {
+        steady_rows.assign(tracked ? (size_t)(y_len * z_len) : 0, 0);
+        steady_cells.assign(tracked ? GetSize() : 0, 0);
+    }
+
+    /// Write to @param filename, going through a temporary file so that an
+    /// interrupted write never replaces the previous checkpoint.
+    bool Write(const std::string & filename) const {
+        const std::string tmp_name = filename + ".tmp";
+        {
+            std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+
+            const uint64_t random_size = random_state.size();
+            const uint64_t steady_size = steady_rows.size();
+            out.write(MAGIC, sizeof(MAGIC));
+            WriteValue(out, VERSION);
+            WriteValue(out, x_len);
+            WriteValue(out, y_len);
+            WriteValue(out, z_len);
+            WriteValue(out, update);
+            WriteValue(out, random_size);
+            WriteValue(out, extra_fields);
+            WriteValue(out, steady_size);
+            WriteArray(out, random_state);
+            WriteArray(out, curr_field);
+            WriteArray(out, next_field);
+            WriteArray(out, occupied);
+            WriteArray(out, producer);
+            WriteArray(out, age);
+            WriteArray(out, resistance);
+            WriteArray(out, extra_curr_field);
+            WriteArray(out, extra_next_field);
+            WriteArray(out, steady_rows);
+            WriteArray(out, steady_cells);
+            if (!out) return false;
+        }
+        return std::rename(tmp_name.c_str(), filename.c_str()) == 0;
+    }
+
+    bool Read(const std::string & filename) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in) return false;
+
+        char magic[sizeof(MAGIC)];
+        uint32_t version = 0;
+        uint64_t random_size = 0;
+        in.read(magic, sizeof(magic));
+        if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+        ReadValue(in, version);
+        if (version < 1 || version > VERSION) return false;
+
+        uint64_t x = 0, y = 0, z = 0;
+        ReadValue(in, x);
+        ReadValue(in, y);
+        ReadValue(in, z);
+        ReadValue(in, update);
+        ReadValue(in, random_size);
+        uint64_t num_extra = 0;
+        uint64_t steady_size = 0;
+        if (version > 1) ReadValue(in, num_extra);
+        if (version > 2) ReadValue(in, steady_size);
+        if (!in || !SizesMatchFile(in, x, y, z, random_size, num_extra, steady_size)) return false;
+        Resize(x, y, z);
+        ResizeExtraFields((size_t)num_extra);
+        ResizeSteadyRows(steady_size != 0);
+        random_state.resize(random_size);
+
+        ReadArray(in, random_state);
+        ReadArray(in, curr_field);
+        ReadArray(in, next_field);
+        ReadArray(in, occupied);
+        ReadArray(in, producer);
+        ReadArray(in, age);
+        ReadArray(in, resistance);
+        ReadArray(in, extra_curr_field);
+        ReadArray(in, extra_next_field);
+        ReadArray(in, steady_rows);
+        ReadArray(in, steady_cells);
+        return (bool)in;
+    }
+
+    private:
+    /// Whether the rest of the file behind @param in holds exactly the
+    /// arrays that the header read so far asks for. Checked before sizing
+    /// any array, so that a damaged or truncated header is rejected rather
+    /// than leading to an allocation of whatever size it claims.
+    static bool SizesMatchFile(std::istream & in, uint64_t x, uint64_t y, uint64_t z, uint64_t random_size,
+                               uint64_t num_extra, uint64_t steady_size) {
+        const std::streamoff header_end = in.tellg();
+        in.seekg(0, std::ios::end);
+        const std::streamoff file_end = in.tellg();
+        in.seekg(header_end);
+        if (!in || file_end < header_end) return false;
+        uint64_t left = (uint64_t)(file_end - header_end);
+
+        // Take @param count items of @param bytes each out of what is left
+        auto take = [&left](uint64_t count, uint64_t bytes) {
+            if (bytes != 0 && count > left / bytes) return false;
+            left -= count * bytes;
+            return true;
+        };
+        const uint64_t voxel_bytes = 2 * sizeof(double) + 2 + sizeof(int32_t) + sizeof(double);
+        if (y != 0 && x > left / y) return false;
+        if (z != 0 && x * y > left / z) return false;
+        const uint64_t size = x * y * z;
+        if (steady_size != 0 && steady_size != y * z) return false;
+        return take(random_size, 1) && take(size, voxel_bytes)
+               && take(num_extra, size * 2 * sizeof(double))
+               && take(steady_size, 1) && take(steady_size ? size : 0, 1)
+               && left == 0;
+    }
+
+    template <typename T>
+    static void WriteValue(std::ostream & out, const T & val) {
+        out.write(reinterpret_cast<const char *>(&val), sizeof(T));
+    }
+
+    template <typename T>
+    static void ReadValue(std::istream & in, T & val) {
+        in.read(reinterpret_cast<char *>(&val), sizeof(T));
+    }
+
+    template <typename T>
+    static void WriteArray(std::ostream & out, const std::vector<T> & vals) {
+        out.write(reinterpret_cast<const char *>(vals.data()), (std::streamsize)(vals.size() * sizeof(T)));
+    }
+
+    template <typename T>
+    static void ReadArray(std::istream & in, std::vector<T> & vals) {
+        in.read(reinterpret_cast<char *>(vals.data()), (std::streamsize)(vals.size() * sizeof(T)));
+    }
+};
+
+/// Writes checkpoints on a background thread, so that the simulation only
+/// pays for copying its state. Holds at most one checkpoint waiting to be
+/// written; submitting another while that one is still waiting blocks
+/// until the writer has taken it.
+class CheckpointWriter {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    Checkpoint pending;
+    std::string pending_file;
+    bool has_pending = false;
+    bool busy = false;
+    bool stopping = false;
+
+    void WorkerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this](){return stopping || has_pending;});
+            if (!has_pending) return;
+
+            Checkpoint cp = std::move(pending);
+            const std::string filename = pending_file;
+            has_pending = false;
+            busy = true;
+            cv.notify_all();
+
+            lock.unlock();
+            if (!cp.Write(filename)) {
+                std::cerr << "Warning: could not write checkpoint '" << filename << "'" << std::endl;
+            }
+            lock.lock();
+            busy = false;
+            cv.notify_all();
+        }
+    }
+
+    public:
+    CheckpointWriter() {;}
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter & operator=(const CheckpointWriter &) = delete;
+
+    ~CheckpointWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    /// Queue @param cp to be written to @param filename
+    void Submit(Checkpoint && cp, const std::string & filename) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!worker.joinable()) {
+            worker = std::thread([this](){ WorkerLoop(); });
+        }
+        cv.wait(lock, [this](){return !has_pending;});
+        pending = std::move(cp);
+        pending_file = filename;
+        has_pending = true;
+        cv.notify_all();
+    }
+
+    /// Block until everything submitted so far is on disk
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this](){return !has_pending && !busy;});
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _CounterRandom_H
+#define _CounterRandom_H
+
+#include <cmath>
+#include <cstdint>
+
+/// Random number stream that is a pure function of a key (seed, update,
+/// voxel) and of how many numbers have been drawn from it. Giving every
+/// voxel its own stream means cells can be updated in any order, or on
+/// any number of threads, and still see the same random numbers.
+///
+/// Numbers come from SplitMix64 started at a hash of the key. Provides the
+/// subset of the emp::Random interface that the cell update uses.
+class CounterRandom {
+    uint64_t state;
+    double cached_normal = 0;
+    bool has_cached_normal = false;
+
+    static uint64_t Mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t Next() {
+        state += 0x9e3779b97f4a7c15ULL;
+        return Mix(state);
+    }
+
+    public:
+    CounterRandom(uint64_t seed, uint64_t update, uint64_t voxel)
+        : state(Mix(Mix(Mix(seed) ^ update) ^ voxel)) {;}
+
+    /// Uniform in [0, 1), with 53 random bits
+    double GetDouble() {
+        return (double)(Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    bool P(double p) {return GetDouble() < p;}
+
+    /// Uniform integer in [min, max)
+    template <typename T1, typename T2>
+    uint32_t GetUInt(T1 min, T2 max) {
+        return (uint32_t)(GetDouble() * (double)(max - min)) + (uint32_t)min;
+    }
+
+    /// Normal deviate (Marsaglia polar method, as in emp::Random)
+    double GetRandNormal(double mean, double std) {
+        if (has_cached_normal) {
+            has_cached_normal = false;
+            return mean + cached_normal * std;
+        }
+        double v1, v2, r;
+        do {
+            v1 = 2.0 * GetDouble() - 1.0;
+            v2 = 2.0 * GetDouble() - 1.0;
+            r = v1 * v1 + v2 * v2;
+        } while (r >= 1.0 || r == 0.0);
+        const double fac = std::sqrt(-2.0 * std::log(r) / r);
+        cached_normal = v1 * fac;
+        has_cached_normal = true;
+        return mean + v2 * fac * std;
+    }
+};
+
+#endif
@@ -0,0 +1,602 @@
+#ifndef _DIFFUSION_KERNELS_H
+#define _DIFFUSION_KERNELS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AlignedBuffer.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+/// Raw view of a ResourceGradient's buffers, as consumed by the stencil
+/// kernels below.
+///
+/// The row kernels are templated on the number of dimensions DIMS (2 or
+/// 3). A 2D grid (z_len == 1) has no rows above or below it: on either
+/// boundary type a row's z neighbors are the row itself, so the 2D
+/// instantiations read the centre value again instead of loading two more
+/// rows and skip the z arithmetic of the row offsets. The centre value is
+/// still added twice, so both instantiations give bit-identical results;
+/// ResourceGradient picks one from z_len at run time.
+///
+/// T is the scalar type of the field (double or float). With COMPENSATED
+/// set the kernels form the Laplacian with compensated summation (see
+/// StepCompensated()), which limits the rounding drift of float fields.
+template <typename T>
+struct StencilGrid {
+    const T * curr;
+    T * next;
+    size_t x_len;
+    size_t y_len;
+    size_t z_len;
+    size_t row_stride;
+    size_t plane_stride;
+    bool toroidal;
+};
+
+namespace stencil {
+
+    /// Add @param val to @param sum, accumulating the rounding error of the
+    /// addition in @param err (Knuth's TwoSum). Exact as long as the
+    /// compiler keeps IEEE semantics, i.e. no -ffast-math.
+    template <typename T>
+    inline void AddCompensated(T & sum, T & err, T val) {
+        const T new_sum = sum + val;
+        const T val_part = new_sum - sum;
+        err += (sum - (new_sum - val_part)) + (val - val_part);
+        sum = new_sum;
+    }
+
+    /// Step() with the Laplacian summed from the neighbors' differences to
+    /// the centre, with compensation. A difference of two nearby values is
+    /// exact (Sterbenz), so this avoids the cancellation of total - 6c,
+    /// which in float loses most of the digits of a smooth field's
+    /// Laplacian. Same value as Step() up to rounding, but not bit-identical.
+    template <typename T>
+    inline T StepCompensated(T c, T l, T r, T t, T b, T d, T u, T coef) {
+        T sum = T(0);
+        T err = T(0);
+        AddCompensated(sum, err, l - c);
+        AddCompensated(sum, err, r - c);
+        AddCompensated(sum, err, t - c);
+        AddCompensated(sum, err, b - c);
+        AddCompensated(sum, err, d - c);
+        AddCompensated(sum, err, u - c);
+        return c + (coef * (sum + err));
+    }
+
+    /// The explicit 7-point update for a single voxel. The additions are
+    /// performed in exactly the order ResourceGradient::GetNeighborOxygen
+    /// uses (left, right, top, bottom, below, above) so that every kernel
+    /// produces bit-identical results. Starting from 0.0 matters too: it
+    /// turns a -0.0 left neighbor into +0.0, just like the original loop.
+    template <bool COMPENSATED, typename T>
+    inline T Step(T c, T l, T r, T t, T b, T d, T u, T coef) {
+        if (COMPENSATED) return StepCompensated(c, l, r, t, b, d, u, coef);
+        T total = T(0) + l;
+        total += r;
+        total += t;
+        total += b;
+        total += d;
+        total += u;
+        return c + (coef * (total - (T(6) * c))); // 6 is from central difference approximation
+    }
+
+    /// Row that acts as neighbor (y + dy, z + dz) of row (y, z). On a
+    /// no-flux boundary that is the row itself; on a toroidal one it wraps.
+    template <typename T>
+    inline const T * NeighborRow(const StencilGrid<T> & g, size_t y, size_t z, int dy, int dz) {
+        size_t ny = y;
+        size_t nz = z;
+        if (dy < 0) {
+            if (y > 0) ny = y - 1;
+            else if (g.toroidal) ny = g.y_len - 1;
+        } else if (dy > 0) {
+            if (y + 1 < g.y_len) ny = y + 1;
+            else if (g.toroidal) ny = 0;
+        }
+        if (dz < 0) {
+            if (z > 0) nz = z - 1;
+            else if (g.toroidal) nz = g.z_len - 1;
+        } else if (dz > 0) {
+            if (z + 1 < g.z_len) nz = z + 1;
+            else if (g.toroidal) nz = 0;
+        }
+        return g.curr + nz * g.plane_stride + ny * g.row_stride;
+    }
+
+    /// Offset of row r, which is (y, z) = (r % y_len, r / y_len), in the
+    /// grid buffers. In 2D, r is y.
+    template <size_t DIMS, typename T>
+    inline size_t RowOffset(const StencilGrid<T> & g, size_t r) {
+        static_assert(DIMS == 2 || DIMS == 3, "Grids are 2D or 3D");
+        if (DIMS == 2) return r * g.row_stride;
+        return (r / g.y_len) * g.plane_stride + (r % g.y_len) * g.row_stride;
+    }
+
+    /// Branch-free update of out[x_begin, x_end) given the centre row and
+    /// its four y/z neighbor rows. Callers guarantee 1 <= x_begin and
+    /// x_end <= x_len - 1 so that row[x-1] and row[x+1] are always valid.
+    /// In 2D, zm and zp are not read.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void RowInteriorScalar(const T * row, const T * ym, const T * yp,
+                                  const T * zm, const T * zp, T * out,
+                                  size_t x_begin, size_t x_end, T coef) {
+        for (size_t x = x_begin; x < x_end; x++) {
+            const T c = row[x];
+            out[x] += Step<COMPENSATED>(c, row[x-1], row[x+1], ym[x], yp[x],
+                                        DIMS == 3 ? zm[x] : c, DIMS == 3 ? zp[x] : c, coef);
+        }
+    }
+
+    // The vectorized kernels cover the plain sum; the compensated one is
+    // left to the compiler.
+#if defined(__AVX512F__)
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const double * row, const double * ym, const double * yp,
+                            const double * zm, const double * zp, double * out,
+                            size_t x_begin, size_t x_end, double coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const __m512d zero = _mm512_setzero_pd();
+            const __m512d six = _mm512_set1_pd(6.0);
+            const __m512d k = _mm512_set1_pd(coef);
+            for (; x + 8 <= x_end; x += 8) {
+                __m512d c = _mm512_loadu_pd(row + x);
+                __m512d total = _mm512_add_pd(zero, _mm512_loadu_pd(row + x - 1));
+                total = _mm512_add_pd(total, _mm512_loadu_pd(row + x + 1));
+                total = _mm512_add_pd(total, _mm512_loadu_pd(ym + x));
+                total = _mm512_add_pd(total, _mm512_loadu_pd(yp + x));
+                total = _mm512_add_pd(total, DIMS == 3 ? _mm512_loadu_pd(zm + x) : c);
+                total = _mm512_add_pd(total, DIMS == 3 ? _mm512_loadu_pd(zp + x) : c);
+                __m512d lap = _mm512_sub_pd(total, _mm512_mul_pd(six, c));
+                __m512d val = _mm512_add_pd(c, _mm512_mul_pd(k, lap));
+                _mm512_storeu_pd(out + x, _mm512_add_pd(_mm512_loadu_pd(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const float * row, const float * ym, const float * yp,
+                            const float * zm, const float * zp, float * out,
+                            size_t x_begin, size_t x_end, float coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const __m512 zero = _mm512_setzero_ps();
+            const __m512 six = _mm512_set1_ps(6.0f);
+            const __m512 k = _mm512_set1_ps(coef);
+            for (; x + 16 <= x_end; x += 16) {
+                __m512 c = _mm512_loadu_ps(row + x);
+                __m512 total = _mm512_add_ps(zero, _mm512_loadu_ps(row + x - 1));
+                total = _mm512_add_ps(total, _mm512_loadu_ps(row + x + 1));
+                total = _mm512_add_ps(total, _mm512_loadu_ps(ym + x));
+                total = _mm512_add_ps(total, _mm512_loadu_ps(yp + x));
+                total = _mm512_add_ps(total, DIMS == 3 ? _mm512_loadu_ps(zm + x) : c);
+                total = _mm512_add_ps(total, DIMS == 3 ? _mm512_loadu_ps(zp + x) : c);
+                __m512 lap = _mm512_sub_ps(total, _mm512_mul_ps(six, c));
+                __m512 val = _mm512_add_ps(c, _mm512_mul_ps(k, lap));
+                _mm512_storeu_ps(out + x, _mm512_add_ps(_mm512_loadu_ps(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+#elif defined(__AVX2__)
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const double * row, const double * ym, const double * yp,
+                            const double * zm, const double * zp, double * out,
+                            size_t x_begin, size_t x_end, double coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const __m256d zero = _mm256_setzero_pd();
+            const __m256d six = _mm256_set1_pd(6.0);
+            const __m256d k = _mm256_set1_pd(coef);
+            for (; x + 4 <= x_end; x += 4) {
+                __m256d c = _mm256_loadu_pd(row + x);
+                __m256d total = _mm256_add_pd(zero, _mm256_loadu_pd(row + x - 1));
+                total = _mm256_add_pd(total, _mm256_loadu_pd(row + x + 1));
+                total = _mm256_add_pd(total, _mm256_loadu_pd(ym + x));
+                total = _mm256_add_pd(total, _mm256_loadu_pd(yp + x));
+                total = _mm256_add_pd(total, DIMS == 3 ? _mm256_loadu_pd(zm + x) : c);
+                total = _mm256_add_pd(total, DIMS == 3 ? _mm256_loadu_pd(zp + x) : c);
+                __m256d lap = _mm256_sub_pd(total, _mm256_mul_pd(six, c));
+                __m256d val = _mm256_add_pd(c, _mm256_mul_pd(k, lap));
+                _mm256_storeu_pd(out + x, _mm256_add_pd(_mm256_loadu_pd(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const float * row, const float * ym, const float * yp,
+                            const float * zm, const float * zp, float * out,
+                            size_t x_begin, size_t x_end, float coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 six = _mm256_set1_ps(6.0f);
+            const __m256 k = _mm256_set1_ps(coef);
+            for (; x + 8 <= x_end; x += 8) {
+                __m256 c = _mm256_loadu_ps(row + x);
+                __m256 total = _mm256_add_ps(zero, _mm256_loadu_ps(row + x - 1));
+                total = _mm256_add_ps(total, _mm256_loadu_ps(row + x + 1));
+                total = _mm256_add_ps(total, _mm256_loadu_ps(ym + x));
+                total = _mm256_add_ps(total, _mm256_loadu_ps(yp + x));
+                total = _mm256_add_ps(total, DIMS == 3 ? _mm256_loadu_ps(zm + x) : c);
+                total = _mm256_add_ps(total, DIMS == 3 ? _mm256_loadu_ps(zp + x) : c);
+                __m256 lap = _mm256_sub_ps(total, _mm256_mul_ps(six, c));
+                __m256 val = _mm256_add_ps(c, _mm256_mul_ps(k, lap));
+                _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_loadu_ps(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+#elif defined(__wasm_simd128__)
+    // WebAssembly SIMD (emcc -msimd128): 128-bit vectors
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const double * row, const double * ym, const double * yp,
+                            const double * zm, const double * zp, double * out,
+                            size_t x_begin, size_t x_end, double coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const v128_t zero = wasm_f64x2_splat(0.0);
+            const v128_t six = wasm_f64x2_splat(6.0);
+            const v128_t k = wasm_f64x2_splat(coef);
+            for (; x + 2 <= x_end; x += 2) {
+                v128_t c = wasm_v128_load(row + x);
+                v128_t total = wasm_f64x2_add(zero, wasm_v128_load(row + x - 1));
+                total = wasm_f64x2_add(total, wasm_v128_load(row + x + 1));
+                total = wasm_f64x2_add(total, wasm_v128_load(ym + x));
+                total = wasm_f64x2_add(total, wasm_v128_load(yp + x));
+                total = wasm_f64x2_add(total, DIMS == 3 ? wasm_v128_load(zm + x) : c);
+                total = wasm_f64x2_add(total, DIMS == 3 ? wasm_v128_load(zp + x) : c);
+                v128_t lap = wasm_f64x2_sub(total, wasm_f64x2_mul(six, c));
+                v128_t val = wasm_f64x2_add(c, wasm_f64x2_mul(k, lap));
+                wasm_v128_store(out + x, wasm_f64x2_add(wasm_v128_load(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+
+    template <size_t DIMS, bool COMPENSATED>
+    inline void RowInterior(const float * row, const float * ym, const float * yp,
+                            const float * zm, const float * zp, float * out,
+                            size_t x_begin, size_t x_end, float coef) {
+        size_t x = x_begin;
+        if (!COMPENSATED) {
+            const v128_t zero = wasm_f32x4_splat(0.0f);
+            const v128_t six = wasm_f32x4_splat(6.0f);
+            const v128_t k = wasm_f32x4_splat(coef);
+            for (; x + 4 <= x_end; x += 4) {
+                v128_t c = wasm_v128_load(row + x);
+                v128_t total = wasm_f32x4_add(zero, wasm_v128_load(row + x - 1));
+                total = wasm_f32x4_add(total, wasm_v128_load(row + x + 1));
+                total = wasm_f32x4_add(total, wasm_v128_load(ym + x));
+                total = wasm_f32x4_add(total, wasm_v128_load(yp + x));
+                total = wasm_f32x4_add(total, DIMS == 3 ? wasm_v128_load(zm + x) : c);
+                total = wasm_f32x4_add(total, DIMS == 3 ? wasm_v128_load(zp + x) : c);
+                v128_t lap = wasm_f32x4_sub(total, wasm_f32x4_mul(six, c));
+                v128_t val = wasm_f32x4_add(c, wasm_f32x4_mul(k, lap));
+                wasm_v128_store(out + x, wasm_f32x4_add(wasm_v128_load(out + x), val));
+            }
+        }
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x, x_end, coef);
+    }
+#else
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void RowInterior(const T * row, const T * ym, const T * yp,
+                            const T * zm, const T * zp, T * out,
+                            size_t x_begin, size_t x_end, T coef) {
+        RowInteriorScalar<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, x_begin, x_end, coef);
+    }
+#endif
+
+    /// Accumulate one explicit diffusion step for a whole row into @param
+    /// out, given the row itself and its four y/z neighbor rows. The x faces
+    /// are peeled off so that the vectorized loop never tests for an edge.
+    /// In 2D, zm and zp must be the row itself.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void StencilRow(const T * row, const T * ym, const T * yp,
+                           const T * zm, const T * zp, T * out,
+                           size_t x_len, bool toroidal, double coef_in) {
+        const T coef = (T)coef_in;
+        const size_t last = x_len - 1;
+        if (x_len == 1) {
+            out[0] += Step<COMPENSATED>(row[0], row[0], row[0], ym[0], yp[0], zm[0], zp[0], coef);
+            return;
+        }
+
+        // Left face
+        out[0] += Step<COMPENSATED>(row[0], toroidal ? row[last] : row[0], row[1],
+                       ym[0], yp[0], zm[0], zp[0], coef);
+
+        RowInterior<DIMS, COMPENSATED>(row, ym, yp, zm, zp, out, 1, last, coef);
+
+        // Right face
+        out[last] += Step<COMPENSATED>(row[last], row[last-1], toroidal ? row[0] : row[last],
+                          ym[last], yp[last], zm[last], zp[last], coef);
+    }
+
+    /// Accumulate one explicit diffusion step for row r, which is (y, z) =
+    /// (r % y_len, r / y_len), into @param out (the start of that row in
+    /// the destination buffer). The y/z faces are handled by choosing the
+    /// right neighbor rows up front.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void DiffuseRow(const StencilGrid<T> & g, double coef, size_t r, T * out) {
+        if (DIMS == 2) {
+            const T * row = g.curr + r * g.row_stride;
+            StencilRow<2, COMPENSATED>(row, NeighborRow(g, r, 0, -1, 0), NeighborRow(g, r, 0, 1, 0), row, row,
+                          out, g.x_len, g.toroidal, coef);
+            return;
+        }
+        const size_t y = r % g.y_len;
+        const size_t z = r / g.y_len;
+        StencilRow<3, COMPENSATED>(g.curr + z * g.plane_stride + y * g.row_stride,
+                   NeighborRow(g, y, z, -1, 0), NeighborRow(g, y, z, 1, 0),
+                   NeighborRow(g, y, z, 0, -1), NeighborRow(g, y, z, 0, 1),
+                   out, g.x_len, g.toroidal, coef);
+    }
+
+    /// Apply one explicit diffusion step to rows [row_begin, row_end),
+    /// accumulating into g.next.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void Diffuse(const StencilGrid<T> & g, double coef, size_t row_begin, size_t row_end) {
+        for (size_t r = row_begin; r < row_end; r++) {
+            DiffuseRow<DIMS, COMPENSATED>(g, coef, r, g.next + RowOffset<DIMS>(g, r));
+        }
+    }
+
+    /// Per-voxel inputs of the fused public good update. The masks are in
+    /// cell id order (x + x_len * (y + y_len * z)), i.e. without padding.
+    struct SourceTerms {
+        const unsigned char * occupied;
+        const unsigned char * producer;
+        double km;
+        double consumption;
+        double production;
+        double decay;
+        double supply = 0; // Added to every voxel, producer or not
+    };
+
+    /// New source value for non-producers ([0]) and producers ([1]),
+    /// computed the way the multi-pass path does it: zero (plus supply),
+    /// add production, subtract decay, clamp.
+    inline void NewSources(const SourceTerms & src, double new_source[2]) {
+        for (int is_producer = 0; is_producer < 2; is_producer++) {
+            double val = src.supply;
+            if (is_producer) val += src.production;
+            val -= src.decay;
+            new_source[is_producer] = val < 0 ? 0 : val;
+        }
+    }
+
+    /// Consumption by the cells in one row, taken out of the pending sources
+    /// @param s given the field @param c they sit in.
+    template <typename T>
+    inline void ConsumeRow(const T * c, T * s, const unsigned char * occupied,
+                           const SourceTerms & src, size_t x_len) {
+        for (size_t x = 0; x < x_len; x++) {
+            if (occupied[x]) {
+                double loss_multiplier = c[x];
+                loss_multiplier /= loss_multiplier + src.km;
+                s[x] -= src.consumption * loss_multiplier;
+                if (s[x] < 0) s[x] = 0;
+            }
+        }
+    }
+
+    /// Everything one HCAWorld::UpdatePublicGood() substep does -- consumption,
+    /// diffusion, the clamp in ResourceGradient::Update() and production/decay
+    /// -- in a single pass over rows [row_begin, row_end). g.next holds the
+    /// pending sources on entry and the new sources on exit; the diffused
+    /// field is written to @param out. Each row is finished while it is
+    /// still in L1, and the arithmetic matches the multi-pass path exactly.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void FusedUpdate(const StencilGrid<T> & g, T * out, const SourceTerms & src,
+                            double coef, size_t row_begin, size_t row_end) {
+        double new_source[2];
+        NewSources(src, new_source);
+
+        for (size_t r = row_begin; r < row_end; r++) {
+            const size_t offset = RowOffset<DIMS>(g, r);
+            const T * c = g.curr + offset;
+            T * s = g.next + offset;
+            T * o = out + offset;
+            const unsigned char * producer = src.producer + r * g.x_len;
+
+            ConsumeRow(c, s, src.occupied + r * g.x_len, src, g.x_len);
+
+            // Diffusion on top of the sources
+            for (size_t x = 0; x < g.x_len; x++) {
+                o[x] = s[x];
+            }
+            DiffuseRow<DIMS, COMPENSATED>(g, coef, r, o);
+
+            // Clamp the new field and lay down the sources for the next step
+            for (size_t x = 0; x < g.x_len; x++) {
+                if (o[x] < 0) o[x] = 0;
+                s[x] = new_source[producer[x] != 0];
+            }
+        }
+    }
+
+    /// FusedUpdate() for @param num_fields fields stored interleaved by row:
+    /// field f of a row starts f * @param field_stride after field 0, which
+    /// is what @param g describes (its strides span all fields). Field f
+    /// has sources @param src[f] and diffusion coefficient @param coefs[f];
+    /// the masks are shared, and taken from src[0].
+    ///
+    /// All fields of a row are finished before the next row, so the work
+    /// that only depends on the row is done once for every field: the
+    /// occupied voxels are listed once, which spares each field the
+    /// unpredictable per-voxel branch on occupancy that dominates
+    /// ConsumeRow(), and the neighbor rows are looked up once. The rows
+    /// the stencil reads for each field sit next to each other in memory.
+    /// Every field gets exactly the result FusedUpdate() would give it on
+    /// its own.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void FusedUpdateFields(const StencilGrid<T> & g, T * out, const SourceTerms * src,
+                                  const double * coefs, size_t num_fields, size_t field_stride,
+                                  size_t row_begin, size_t row_end) {
+        std::vector<double> new_source(2 * num_fields);
+        for (size_t f = 0; f < num_fields; f++) {
+            NewSources(src[f], &new_source[2 * f]);
+        }
+        std::vector<uint32_t> cells(g.x_len); // x of the occupied voxels in the row
+
+        for (size_t r = row_begin; r < row_end; r++) {
+            const size_t offset = RowOffset<DIMS>(g, r);
+            const size_t y = DIMS == 2 ? r : r % g.y_len;
+            const size_t z = DIMS == 2 ? 0 : r / g.y_len;
+            const T * row = g.curr + offset;
+            const T * ym = NeighborRow(g, y, z, -1, 0);
+            const T * yp = NeighborRow(g, y, z, 1, 0);
+            const T * zm = DIMS == 3 ? NeighborRow(g, y, z, 0, -1) : row;
+            const T * zp = DIMS == 3 ? NeighborRow(g, y, z, 0, 1) : row;
+            const unsigned char * occupied = src[0].occupied + r * g.x_len;
+            const unsigned char * producer = src[0].producer + r * g.x_len;
+
+            size_t num_cells = 0;
+            for (size_t x = 0; x < g.x_len; x++) {
+                cells[num_cells] = (uint32_t)x;
+                num_cells += occupied[x] != 0;
+            }
+
+            for (size_t f = 0; f < num_fields; f++) {
+                const size_t shift = f * field_stride;
+                const T * c = row + shift;
+                T * s = g.next + offset + shift;
+                T * o = out + offset + shift;
+                const double * field_source = &new_source[2 * f];
+
+                // ConsumeRow() over the listed voxels
+                for (size_t i = 0; i < num_cells; i++) {
+                    const size_t x = cells[i];
+                    double loss_multiplier = c[x];
+                    loss_multiplier /= loss_multiplier + src[f].km;
+                    s[x] -= src[f].consumption * loss_multiplier;
+                    if (s[x] < 0) s[x] = 0;
+                }
+
+                for (size_t x = 0; x < g.x_len; x++) {
+                    o[x] = s[x];
+                }
+                StencilRow<DIMS, COMPENSATED>(c, ym + shift, yp + shift, zm + shift, zp + shift,
+                                              o, g.x_len, g.toroidal, coefs[f]);
+                for (size_t x = 0; x < g.x_len; x++) {
+                    if (o[x] < 0) o[x] = 0;
+                    s[x] = field_source[producer[x] != 0];
+                }
+            }
+        }
+    }
+
+    /// Overwrite the pending sources in rows [row_begin, row_end) with the
+    /// ones left behind by a completed step (used after BlockedUpdate).
+    template <size_t DIMS, typename T>
+    inline void ResetSources(const StencilGrid<T> & g, const SourceTerms & src,
+                             size_t row_begin, size_t row_end) {
+        double new_source[2];
+        NewSources(src, new_source);
+        for (size_t r = row_begin; r < row_end; r++) {
+            T * s = g.next + RowOffset<DIMS>(g, r);
+            const unsigned char * producer = src.producer + r * g.x_len;
+            for (size_t x = 0; x < g.x_len; x++) {
+                s[x] = new_source[producer[x] != 0];
+            }
+        }
+    }
+
+    /// Temporally blocked version of @param steps consecutive FusedUpdate()
+    /// calls, for a population that does not change in between. Rather than
+    /// sweeping the whole grid once per step, rows are pushed through all
+    /// steps as a wavefront. With d the distance between a row and its
+    /// farthest stencil neighbor (y_len in 3D, 1 in 2D), step t works on
+    /// row r while step t-1 is d + 1 rows ahead of it, so each step only
+    /// needs a window of 2 * d + 2 rows (about two planes in 3D, four rows
+    /// in 2D) of its predecessor, which stays in cache. Main memory is
+    /// therefore streamed once per @param steps substeps. Results are
+    /// bit-identical to the unblocked path.
+    ///
+    /// The field after the last step is written to @param out for rows
+    /// [row_begin, row_end) only. To produce those rows the earlier steps
+    /// also have to cover a halo of d rows per remaining step on either
+    /// side, which is recomputed redundantly so that disjoint row ranges can
+    /// run concurrently. g.next is only read; call ResetSources() afterwards.
+    /// Not valid for toroidal grids, where row 0 depends on the last row.
+    template <size_t DIMS, bool COMPENSATED, typename T>
+    inline void BlockedUpdate(const StencilGrid<T> & g, T * out, const SourceTerms & src,
+                              double coef, size_t steps, size_t row_begin, size_t row_end) {
+        if (row_begin >= row_end || steps == 0) return;
+
+        const size_t num_rows = g.y_len * g.z_len;
+        const size_t row_distance = DIMS == 3 ? g.y_len : 1; // To the farthest neighbor row
+        const size_t lag = row_distance + 1;
+        const size_t window = 2 * row_distance + 2;
+        double new_source[2];
+        NewSources(src, new_source);
+
+        // Ring buffers for the intermediate steps, plus one row of sources
+        AlignedBuffer<T> work(((steps - 1) * window + 1) * g.row_stride);
+        T * sources = work.data() + (steps - 1) * window * g.row_stride;
+
+        // Rows that step t (1-based) has to produce
+        std::vector<size_t> lo(steps + 1);
+        std::vector<size_t> hi(steps + 1);
+        for (size_t t = 1; t <= steps; t++) {
+            const size_t reach = (steps - t) * row_distance;
+            lo[t] = row_begin > reach ? row_begin - reach : 0;
+            hi[t] = std::min(num_rows, row_end + reach);
+        }
+
+        // Row r of the field as it is before step t + 1
+        auto level_row = [&](size_t t, size_t r) -> T * {
+            if (t == 0) return const_cast<T *>(g.curr) + RowOffset<DIMS>(g, r);
+            if (t == steps) return out + RowOffset<DIMS>(g, r);
+            return work.data() + ((t - 1) * window + r % window) * g.row_stride;
+        };
+
+        const size_t last_tick = hi[steps] - 1 + (steps - 1) * lag;
+        for (size_t tick = lo[1]; tick <= last_tick; tick++) {
+            for (size_t t = 1; t <= steps; t++) {
+                if (tick < (t - 1) * lag) break;
+                const size_t r = tick - (t - 1) * lag;
+                if (r < lo[t] || r >= hi[t]) continue;
+
+                const size_t y = r % g.y_len;
+                const size_t z = r / g.y_len;
+                const T * c = level_row(t - 1, r);
+                const T * ym = y > 0 ? level_row(t - 1, r - 1) : c;
+                const T * yp = y + 1 < g.y_len ? level_row(t - 1, r + 1) : c;
+                const T * zm = DIMS == 3 && z > 0 ? level_row(t - 1, r - g.y_len) : c;
+                const T * zp = DIMS == 3 && z + 1 < g.z_len ? level_row(t - 1, r + g.y_len) : c;
+                T * o = level_row(t, r);
+                const unsigned char * producer = src.producer + r * g.x_len;
+
+                if (t == 1) {
+                    const T * pending = g.next + RowOffset<DIMS>(g, r);
+                    for (size_t x = 0; x < g.x_len; x++) sources[x] = pending[x];
+                } else {
+                    for (size_t x = 0; x < g.x_len; x++) sources[x] = new_source[producer[x] != 0];
+                }
+                ConsumeRow(c, sources, src.occupied + r * g.x_len, src, g.x_len);
+
+                for (size_t x = 0; x < g.x_len; x++) {
+                    o[x] = sources[x];
+                }
+                StencilRow<DIMS, COMPENSATED>(c, ym, yp, zm, zp, o, g.x_len, false, coef);
+                for (size_t x = 0; x < g.x_len; x++) {
+                    if (o[x] < 0) o[x] = 0;
+                }
+            }
+        }
+    }
+}
+
+#endif
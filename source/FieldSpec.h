@@ -0,0 +1,73 @@
+#ifndef _FieldSpec_H
+#define _FieldSpec_H
+
+#include <cstdlib>
+#include <string>
+
+#include "base/vector.h"
+
+/// A diffusing field besides the public good (EXTRA_FIELDS), for example a
+/// second good or a drug that is not uniform. It diffuses and decays like
+/// the public good, with its own parameters: producers secrete it at
+/// production, occupied voxels take it up at consumption (Michaelis-Menten,
+/// with the model's KM) and supply is added to every voxel each step, as
+/// for a drug perfusing the medium. Each unit of the field in a cell's
+/// voxel adds effect to the cell's death probability: -1 for a good that
+/// protects like the public good, 1 for a drug.
+struct FieldSpec {
+    std::string name;
+    double effect = 0;
+    double diffusion = 0;
+    double decay = 0;
+    double production = 0;
+    double consumption = 0;
+    double supply = 0;
+    double initial = 0;
+
+    /// Parse @param text into @param specs: entries separated by ';', each
+    ///   name:effect:diffusion:decay:production:consumption:supply:initial
+    /// where values left off the end are 0. On failure @return false with
+    /// the reason in @param error.
+    static bool ParseList(const std::string & text, emp::vector<FieldSpec> & specs, std::string & error) {
+        specs.clear();
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t end = text.find(';', start);
+            if (end == std::string::npos) end = text.size();
+            const std::string entry = text.substr(start, end - start);
+            start = end + 1;
+            if (entry.empty()) continue;
+
+            emp::vector<std::string> parts;
+            size_t part_start = 0;
+            while (true) {
+                const size_t part_end = entry.find(':', part_start);
+                parts.push_back(entry.substr(part_start, part_end - part_start));
+                if (part_end == std::string::npos) break;
+                part_start = part_end + 1;
+            }
+
+            FieldSpec spec;
+            double * vals[] = {&spec.effect, &spec.diffusion, &spec.decay, &spec.production,
+                               &spec.consumption, &spec.supply, &spec.initial};
+            const size_t num_vals = sizeof(vals) / sizeof(vals[0]);
+            spec.name = parts[0];
+            if (spec.name.empty() || parts.size() > num_vals + 1) {
+                error = "bad entry '" + entry + "'";
+                return false;
+            }
+            for (size_t i = 1; i < parts.size(); i++) {
+                char * parsed_end = nullptr;
+                *vals[i - 1] = std::strtod(parts[i].c_str(), &parsed_end);
+                if (parts[i].empty() || *parsed_end != '\0') {
+                    error = "bad number '" + parts[i] + "' in entry '" + entry + "'";
+                    return false;
+                }
+            }
+            specs.push_back(spec);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef _HCAGridWorld_H
+#define _HCAGridWorld_H
+
+#include "CounterRandom.h"
+#include "public_goods_model.h"
+
+/// Alternative to HCAWorld that stores the population as flat per-voxel
+/// arrays (structure of arrays) instead of one heap-allocated Cell per
+/// organism. The next generation is built up in a second set of arrays
+/// that Update() swaps in, so a step does no allocation at all.
+///
+/// RunStep() draws random numbers in the same order as HCAWorld, so a run
+/// with the same seed and config gives the same population and public good.
+/// There are no emp::World signals or systematics; use HCAWorld for those.
+///
+/// With PARALLEL_CELL_UPDATE, RunStep() instead splits the grid into
+/// blocks of FATE_BLOCK^3 voxels with 27 colors (3 per axis). A cell only
+/// writes the next generation within one voxel of itself, so blocks of the
+/// same color never write the same voxel and are updated concurrently,
+/// one color after another. Each cell draws from a CounterRandom keyed on
+/// (seed, update, voxel), so the result does not depend on the number of
+/// threads.
+class HCAGridWorld : public HCAModelBase {
+  protected:
+  emp::Ptr<emp::Random> random_ptr;
+  size_t update = 0;
+  bool run_diffusion = true; // Web version does diffusion separately
+
+  // Current generation. Occupancy and the producer flag are the
+  // occupied_mask/producer_mask arrays of HCAModelBase.
+  emp::vector<int> age;
+  emp::vector<double> resistance;
+
+  // Next generation, filled in by RunStep()
+  emp::vector<unsigned char> next_occupied;
+  OccupancyBitset next_bits;
+  emp::vector<unsigned char> next_producer;
+  emp::vector<int> next_age;
+  emp::vector<double> next_resistance;
+
+  static constexpr size_t FATE_BLOCK = 16;
+  size_t num_blocks_x = 0;
+  size_t num_blocks_y = 0;
+  emp::vector<emp::vector<size_t>> color_blocks; // Block ids of each color
+  bool parallel_step = false; // Inside a parallel RunStep()
+
+  /// The masks are the population itself, so they are always current
+  void RefreshCellMasks() override {;}
+
+  /// Put a cell into the next generation at @param cell_id, replacing
+  /// whatever was placed there earlier this step.
+  void PlaceNext(size_t cell_id, int in_age, bool in_producer, double in_resistance) {
+    next_occupied[cell_id] = 1;
+    if (parallel_step) {
+      next_bits.SetAtomic(cell_id);
+    } else {
+      next_bits.Set(cell_id);
+    }
+    next_producer[cell_id] = in_producer;
+    next_age[cell_id] = in_age;
+    next_resistance[cell_id] = in_resistance;
+  }
+
+  /// Make the next generation current and start a new, empty one
+  void SwapGenerations() {
+    std::swap(occupied_mask, next_occupied);
+    std::swap(producer_mask, next_producer);
+    std::swap(age, next_age);
+    std::swap(resistance, next_resistance);
+    occupied_bits.Swap(next_bits);
+    std::fill(next_occupied.begin(), next_occupied.end(), 0);
+    std::fill(next_producer.begin(), next_producer.end(), 0);
+    next_bits.Clear();
+  }
+
+  /// Size both generations for WORLD_X * WORLD_Y * WORLD_Z voxels, all empty
+  void AllocateCells() {
+    const size_t size = WORLD_X * WORLD_Y * WORLD_Z;
+    occupied_mask.assign(size, 0);
+    producer_mask.assign(size, 0);
+    age.assign(size, 0);
+    resistance.assign(size, 0);
+    next_occupied.assign(size, 0);
+    next_producer.assign(size, 0);
+    next_age.assign(size, 0);
+    next_resistance.assign(size, 0);
+    occupied_bits.Resize(size);
+    next_bits.Resize(size);
+  }
+
+  void SetupBlocks() {
+    num_blocks_x = (WORLD_X + FATE_BLOCK - 1) / FATE_BLOCK;
+    num_blocks_y = (WORLD_Y + FATE_BLOCK - 1) / FATE_BLOCK;
+    const size_t num_blocks_z = (WORLD_Z + FATE_BLOCK - 1) / FATE_BLOCK;
+    color_blocks.assign(27, emp::vector<size_t>());
+    for (size_t bz = 0; bz < num_blocks_z; bz++) {
+      for (size_t by = 0; by < num_blocks_y; by++) {
+        for (size_t bx = 0; bx < num_blocks_x; bx++) {
+          const size_t color = (bz % 3) * 9 + (by % 3) * 3 + bx % 3;
+          color_blocks[color].push_back((bz * num_blocks_y + by) * num_blocks_x + bx);
+        }
+      }
+    }
+  }
+
+  /// Update every cell of block @param block, in voxel order
+  void UpdateBlock(size_t block, uint64_t seed) {
+    const size_t bx = block % num_blocks_x;
+    const size_t by = (block / num_blocks_x) % num_blocks_y;
+    const size_t bz = (block / num_blocks_x) / num_blocks_y;
+    const size_t x_begin = bx * FATE_BLOCK;
+    const size_t x_end = std::min(x_begin + FATE_BLOCK, WORLD_X);
+    for (size_t z = bz * FATE_BLOCK; z < std::min((bz + 1) * FATE_BLOCK, WORLD_Z); z++) {
+      for (size_t y = by * FATE_BLOCK; y < std::min((by + 1) * FATE_BLOCK, WORLD_Y); y++) {
+        const size_t row = (z * WORLD_Y + y) * WORLD_X;
+        occupied_bits.ForEachSet(row + x_begin, row + x_end, [this, seed](size_t cell_id){
+          CounterRandom random(seed, update, cell_id);
+          UpdateCell(cell_id, random);
+        });
+      }
+    }
+  }
+
+  public:
+  HCAGridWorld(emp::Random & r) : random_ptr(&r) {;}
+
+  size_t GetSize() const {return occupied_mask.size();}
+  size_t GetUpdate() const {return update;}
+  emp::Random & GetRandom() {return *random_ptr;}
+
+  bool IsOccupied(size_t cell_id) const {
+    return occupied_mask[cell_id];
+  }
+
+  size_t GetNumOrgs() const {
+    return occupied_bits.Count();
+  }
+
+  /// Copy of the cell at @param cell_id (which must be occupied)
+  Cell GetOrg(size_t cell_id) const {
+    Cell cell(resistance[cell_id], producer_mask[cell_id]);
+    cell.age = age[cell_id];
+    return cell;
+  }
+
+  void InitPop() {
+    for (size_t cell_id = 0; cell_id < (size_t)INIT_POP_SIZE; cell_id++) {
+      const bool producer = random_ptr->P(.5);
+      PlaceNext(random_ptr->GetUInt(0, GetSize()), 0, producer, 0);
+    }
+    // Injected cells go straight into the current generation
+    SwapGenerations();
+  }
+
+  void Reset(PublicGoodsConfig & config, bool web = false) {
+    DeletePublicGood();
+    update = 0;
+    Setup(config, web);
+  }
+
+  void Setup(PublicGoodsConfig & config, bool web = false) {
+    InitConfigs(config);
+    NewPublicGood();
+    run_diffusion = !web;
+
+    AllocateCells();
+    SetupBlocks();
+    InitPublicGood();
+    InitPop();
+  }
+
+  /// Determine if cell can divide (i.e. is space available). If yes, return
+  /// id of cell that it can divide into. If not, return -1.
+  int CanDivide(size_t cell_id) {
+    return CanDivide(cell_id, *random_ptr);
+  }
+
+  template <typename RANDOM>
+  int CanDivide(size_t cell_id, RANDOM & random) {
+    const uint32_t open_spots = occupied_bits.EmptyNeighbors(neighbors, cell_id);
+    if (open_spots == 0) {
+      return -1;
+    }
+    const size_t pick = random.GetUInt(0, OccupancyBitset::CountBits(open_spots));
+    return (int)neighbors.GetNeighbor(cell_id, OccupancyBitset::SelectBit(open_spots, pick));
+  }
+
+  /// Place a mutated daughter of the cell at @param parent_id into the
+  /// next generation at @param cell_id.
+  template <typename RANDOM>
+  void PlaceOffspring(size_t parent_id, size_t cell_id, RANDOM & random) {
+    const double mutation = random.GetRandNormal(0, RESISTANCE_MUT_STDEV);
+    PlaceNext(cell_id, 0, producer_mask[parent_id], resistance[parent_id] + mutation);
+  }
+
+  void Quiesce(size_t cell_id) {
+    // Quiescence - keep the cell in the same spot, one step older
+    age[cell_id]++;
+    if (age[cell_id] < AGE_LIMIT) {
+      HCA_PROFILE_COUNT(QUIESCENCES);
+      PlaceNext(cell_id, age[cell_id], producer_mask[cell_id], resistance[cell_id]);
+    } else {
+      HCA_PROFILE_COUNT(DEATHS);
+    }
+  }
+
+  /// Death, division or quiescence of the cell at @param cell_id, drawing
+  /// from @param random
+  template <typename RANDOM>
+  void UpdateCell(size_t cell_id, RANDOM & random) {
+    double death_prob = DRUG_CONCENTRATION - resistance[cell_id] - GetCellPublicGood(cell_id);
+    if (!extra_fields.empty()) {
+      death_prob += GetCellFieldEffect(cell_id);
+    }
+    if (death_prob > 1) {
+      death_prob = 1;
+    } else if (death_prob < 0) {
+      death_prob = 0;
+    }
+
+    if (random.P(death_prob)) {
+      HCA_PROFILE_COUNT(DEATHS);
+      return; // Not placing the cell in the next generation = death
+    }
+
+    int potential_offspring_cell = CanDivide(cell_id, random);
+
+    double repro_prob = MITOSIS_PROB;
+    if (producer_mask[cell_id]) {
+      repro_prob *= PRODUCER_RELATIVE_FITNESS;
+    }
+    if (repro_prob > 1) {
+      repro_prob = 1;
+    } else if (repro_prob < 0) {
+      repro_prob = 0;
+    }
+
+    if (potential_offspring_cell != -1 && random.P(repro_prob)) {
+      HCA_PROFILE_COUNT(DIVISIONS);
+      PlaceOffspring(cell_id, (size_t)potential_offspring_cell, random);
+      PlaceOffspring(cell_id, cell_id, random);
+    } else {
+      Quiesce(cell_id);
+    }
+  }
+
+  void RunStep() {
+    if (show_progress) Logger::Get().Progress(update);
+
+    HCA_PROFILE_BEGIN(CELL_FATES);
+    if (PARALLEL_CELL_UPDATE) {
+      const uint64_t seed = (uint64_t)random_ptr->GetSeed();
+      parallel_step = true;
+      for (const emp::vector<size_t> & blocks : color_blocks) {
+        thread_pool.ParallelFor(0, blocks.size(), [this, &blocks, seed](size_t begin, size_t end){
+          for (size_t i = begin; i < end; i++) {
+            UpdateBlock(blocks[i], seed);
+          }
+        });
+      }
+      parallel_step = false;
+    } else {
+      const size_t num_cells = WORLD_X * WORLD_Y * WORLD_Z;
+      for (size_t cell_id = occupied_bits.FindNext(0); cell_id < num_cells; cell_id = occupied_bits.FindNext(cell_id + 1)) {
+        UpdateCell(cell_id, *random_ptr);
+      }
+    }
+
+    HCA_PROFILE_END();
+    Update();
+    CheckpointIfDue(update);
+    SnapshotIfDue(update);
+    ProfileIfDue(update);
+  }
+
+  Checkpoint GetCheckpoint() override {
+    Checkpoint cp;
+    cp.Resize(WORLD_X, WORLD_Y, WORLD_Z);
+    cp.update = update;
+    SaveRandom(*random_ptr, cp);
+    SaveField(cp);
+    std::copy(occupied_mask.begin(), occupied_mask.end(), cp.occupied.begin());
+    std::copy(producer_mask.begin(), producer_mask.end(), cp.producer.begin());
+    // Traits of empty voxels are left over from earlier cells; save them as 0
+    occupied_bits.ForEachSet(0, occupied_bits.size(), [this, &cp](size_t cell_id){
+      cp.age[cell_id] = age[cell_id];
+      cp.resistance[cell_id] = resistance[cell_id];
+    });
+    return cp;
+  }
+
+  /// Continue the run saved in checkpoint @param filename. Call after
+  /// Setup() with the same config.
+  bool LoadCheckpoint(const std::string & filename) {
+    Checkpoint cp;
+    if (!ReadCheckpoint(filename, cp) || !LoadRandom(*random_ptr, cp)) return false;
+
+    occupied_bits.Clear();
+    for (size_t cell_id = 0; cell_id < cp.GetSize(); cell_id++) {
+      occupied_mask[cell_id] = cp.occupied[cell_id] != 0;
+      producer_mask[cell_id] = cp.occupied[cell_id] && cp.producer[cell_id];
+      age[cell_id] = cp.age[cell_id];
+      resistance[cell_id] = cp.resistance[cell_id];
+      if (occupied_mask[cell_id]) {
+        occupied_bits.Set(cell_id);
+      }
+    }
+
+    update = cp.update;
+    LoadField(cp);
+    return true;
+  }
+
+  /// Equivalent of emp::World::Update(): record data, run the public good
+  /// for this time step (against the generation that just acted), then
+  /// make the next generation current.
+  void Update() {
+    HCA_PROFILE_SCOPE(WORLD_UPDATE);
+    PopulationIfDue(update, GetNumOrgs());
+
+    if (run_diffusion) {
+      UpdatePublicGood(DIFFUSION_STEPS_PER_TIME_STEP);
+    }
+
+    SwapGenerations();
+    update++;
+  }
+
+  void Run() {
+      Logger::Get().StartProgress(update, (size_t)TIME_STEPS + 1);
+      for (int u = (int)update; u <= TIME_STEPS; u++) {
+          RunStep();
+      }
+      Logger::Get().FinishProgress(update);
+      FinishProfile();
+  }
+
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef _HCASlabWorld_H
+#define _HCASlabWorld_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "HCAGridWorld.h"
+#include "SlabComm.h"
+
+/// HCAGridWorld split across processes (WORLD_ENGINE slab), for grids
+/// that do not fit in one address space. The grid is cut along z into
+/// slabs of whole FATE_BLOCK-plane blocks, one slab per process of the
+/// SlabComm, so a WORLD_Z of Z allows up to ceil(Z / FATE_BLOCK)
+/// processes. Each process stores its slab plus a ghost plane on each
+/// side that has a neighbor, holding a copy of the neighbor's edge plane:
+///
+///   occupancy, refreshed after every update, so that CanDivide() sees
+///   cells across the boundary;
+///
+///   the public good, refreshed before every diffusion step, for the
+///   stencil.
+///
+/// Cells are always updated as with PARALLEL_CELL_UPDATE: blocks in 27
+/// colors, one color after another, each cell drawing from a CounterRandom
+/// keyed on its voxel id in the whole grid. Daughters placed in a ghost
+/// plane belong to the neighbor; they are sent to it after each third of
+/// the colors (one z color), before anything that could overwrite them
+/// runs. A run therefore gives exactly the same result as HCAGridWorld
+/// with PARALLEL_CELL_UPDATE, whatever the number of processes.
+///
+/// The public good is advanced one explicit step at a time
+/// (TEMPORAL_BLOCK_STEPS, DIFFUSION_SOLVER adi, ACTIVE_REGION and
+/// STEADY_STATE are turned off). Every DATA_RESOLUTION updates the
+/// population statistics are summed over all processes; the root writes
+/// POPULATION_FILE and the log. Checkpoints, snapshots and restarts are not supported.
+class HCASlabWorld : public HCAGridWorld {
+  public:
+  /// Population totals over the whole grid
+  struct Stats {
+    double cells = 0;
+    double producers = 0;
+    double resistance = 0;  // Sum over cells
+    double public_good = 0; // Sum over voxels
+  };
+
+  protected:
+  /// A cell placed in a ghost plane, on its way to the plane's owner
+  struct Placement {
+    uint64_t index; // Within the plane
+    double resistance;
+    int32_t age;
+    int32_t producer;
+  };
+
+  SlabComm & comm;
+  size_t global_z = 0;     // WORLD_Z of the whole grid; WORLD_Z is the local slab
+  size_t z_begin = 0;      // Owned planes [z_begin, z_end), in global z
+  size_t z_end = 0;
+  size_t ghost_lo = 0;     // 1 if there is a ghost plane below the slab
+  size_t ghost_hi = 0;     // 1 if there is one above
+  size_t plane_size = 0;   // Voxels per plane
+  size_t id_offset = 0;    // Global voxel id of local voxel 0
+  int lower = SlabComm::NONE;
+  int upper = SlabComm::NONE;
+  Stats stats;             // As of the last DATA_RESOLUTION update
+
+  /// Owned planes [@param begin, @param end) of process @param rank of
+  /// @param num_procs
+  void SlabRange(int rank, int num_procs, size_t & begin, size_t & end) const {
+    const size_t num_blocks_z = (global_z + FATE_BLOCK - 1) / FATE_BLOCK;
+    begin = (size_t)rank * num_blocks_z / (size_t)num_procs * FATE_BLOCK;
+    end = std::min((size_t)(rank + 1) * num_blocks_z / (size_t)num_procs * FATE_BLOCK, global_z);
+  }
+
+  /// Blocks of this slab by color, as HCAGridWorld::SetupBlocks() numbers
+  /// them in the whole grid
+  void SetupSlabBlocks() {
+    num_blocks_x = (WORLD_X + FATE_BLOCK - 1) / FATE_BLOCK;
+    num_blocks_y = (WORLD_Y + FATE_BLOCK - 1) / FATE_BLOCK;
+    color_blocks.assign(27, emp::vector<size_t>());
+    for (size_t bz = z_begin / FATE_BLOCK; bz * FATE_BLOCK < z_end; bz++) {
+      for (size_t by = 0; by < num_blocks_y; by++) {
+        for (size_t bx = 0; bx < num_blocks_x; bx++) {
+          const size_t color = (bz % 3) * 9 + (by % 3) * 3 + bx % 3;
+          color_blocks[color].push_back((bz * num_blocks_y + by) * num_blocks_x + bx);
+        }
+      }
+    }
+  }
+
+  /// HCAGridWorld::UpdateBlock() for global block @param block
+  void UpdateSlabBlock(size_t block, uint64_t seed) {
+    const size_t bx = block % num_blocks_x;
+    const size_t by = (block / num_blocks_x) % num_blocks_y;
+    const size_t bz = (block / num_blocks_x) / num_blocks_y;
+    const size_t x_begin = bx * FATE_BLOCK;
+    const size_t x_end = std::min(x_begin + FATE_BLOCK, WORLD_X);
+    for (size_t z = bz * FATE_BLOCK; z < std::min((bz + 1) * FATE_BLOCK, z_end); z++) {
+      for (size_t y = by * FATE_BLOCK; y < std::min((by + 1) * FATE_BLOCK, WORLD_Y); y++) {
+        const size_t row = ((z - z_begin + ghost_lo) * WORLD_Y + y) * WORLD_X;
+        occupied_bits.ForEachSet(row + x_begin, row + x_end, [this, seed](size_t cell_id){
+          CounterRandom random(seed, update, cell_id + id_offset);
+          UpdateCell(cell_id, random);
+        });
+      }
+    }
+  }
+
+  /// Fill the ghost planes of @param data (@param plane values per plane,
+  /// local planes in order) from the neighbors' edge planes
+  template <typename T>
+  void ExchangeGhosts(T * data, size_t plane) {
+    const size_t bytes = plane * sizeof(T);
+    const size_t top = WORLD_Z - 1;
+    // Bottom owned plane down, into the lower neighbor's top ghost
+    comm.SendRecv(lower, data + ghost_lo * plane, bytes, upper, data + top * plane, bytes);
+    // Top owned plane up, into the upper neighbor's bottom ghost
+    comm.SendRecv(upper, data + (top - ghost_hi) * plane, bytes, lower, data, bytes);
+  }
+
+  /// Refresh the ghost planes of the current generation
+  void ExchangeCells() {
+    ExchangeGhosts(occupied_mask.data(), plane_size);
+    ExchangeGhosts(producer_mask.data(), plane_size);
+    const size_t planes[2] = {0, WORLD_Z - 1};
+    for (size_t i = 0; i < 2; i++) {
+      if ((i == 0 && !ghost_lo) || (i == 1 && !ghost_hi)) continue;
+      for (size_t cell_id = planes[i] * plane_size; cell_id < (planes[i] + 1) * plane_size; cell_id++) {
+        if (occupied_mask[cell_id]) occupied_bits.Set(cell_id);
+        else occupied_bits.Reset(cell_id);
+      }
+    }
+  }
+
+  /// Refresh the ghost planes of the public good
+  void ExchangeField() {
+    WithPublicGood([this](auto & grad){
+      ExchangeGhosts(grad.GetCurrData(), grad.GetPlaneStride());
+    });
+  }
+
+  /// Remove the cells placed in ghost plane @param plane this step from
+  /// the next generation and @return them
+  emp::vector<Placement> TakePlacements(size_t plane) {
+    emp::vector<Placement> placed;
+    const size_t start = plane * plane_size;
+    next_bits.ForEachSet(start, start + plane_size, [this, start, &placed](size_t cell_id){
+      placed.push_back(Placement{cell_id - start, next_resistance[cell_id], next_age[cell_id], next_producer[cell_id]});
+      next_occupied[cell_id] = 0;
+      next_producer[cell_id] = 0;
+      next_bits.Reset(cell_id);
+    });
+    return placed;
+  }
+
+  /// Send the cells placed in ghost plane @param ghost_plane to @param
+  /// dest, and place those that @param source sends into local plane
+  /// @param owned_plane
+  void ExchangePlacements(int dest, size_t ghost_plane, int source, size_t owned_plane) {
+    emp::vector<Placement> sent;
+    if (dest != SlabComm::NONE) sent = TakePlacements(ghost_plane);
+    uint64_t num_sent = sent.size(), num_received = 0;
+    comm.SendRecv(dest, &num_sent, sizeof(num_sent), source, &num_received, sizeof(num_received));
+    emp::vector<Placement> received(num_received);
+    comm.SendRecv(dest, sent.data(), sent.size() * sizeof(Placement),
+                  source, received.data(), received.size() * sizeof(Placement));
+    const size_t start = owned_plane * plane_size;
+    for (const Placement & cell : received) {
+      PlaceNext(start + cell.index, cell.age, cell.producer != 0, cell.resistance);
+    }
+  }
+
+  /// Hand daughters placed in the ghost planes to their owners
+  void SendPlacements() {
+    const size_t top = WORLD_Z - 1;
+    ExchangePlacements(lower, 0, upper, top - ghost_hi);
+    ExchangePlacements(upper, top, lower, ghost_lo);
+  }
+
+  void InitSlabPop() {
+    const size_t size = WORLD_X * WORLD_Y * global_z;
+    for (size_t i = 0; i < (size_t)INIT_POP_SIZE; i++) {
+      const bool producer = random_ptr->P(.5);
+      const size_t cell_id = random_ptr->GetUInt(0, size);
+      const size_t z = cell_id / plane_size;
+      if (z >= z_begin && z < z_end) {
+        PlaceNext(cell_id - id_offset, 0, producer, 0);
+      }
+    }
+    SwapGenerations();
+  }
+
+  /// Record data and advance the public good and the population by one
+  /// update (as HCAGridWorld::Update())
+  void Update() {
+    HCA_PROFILE_SCOPE(WORLD_UPDATE);
+    if (DATA_RESOLUTION > 0 && update % (size_t)DATA_RESOLUTION == 0) {
+      stats = GetGlobalStats();
+      PopulationIfDue(update, (size_t)stats.cells);
+    }
+
+    for (int step = 0; step < DIFFUSION_STEPS_PER_TIME_STEP; step++) {
+      ExchangeField();
+      UpdatePublicGood();
+    }
+
+    SwapGenerations();
+    update++;
+    ExchangeCells();
+  }
+
+  public:
+  HCASlabWorld(emp::Random & r, SlabComm & in_comm) : HCAGridWorld(r), comm(in_comm) {;}
+
+  /// Set up this process's slab. Collective; @return false (on every
+  /// process) if the grid cannot be split over this many processes.
+  bool Setup(PublicGoodsConfig & config) {
+    InitConfigs(config);
+    global_z = WORLD_Z;
+    if (!comm.IsRoot()) show_progress = false;
+
+    const bool root = comm.IsRoot();
+    if (IMPLICIT_DIFFUSION || TEMPORAL_BLOCK_STEPS > 1 || ACTIVE_REGION || STEADY_STATE) {
+      if (root) std::cerr << "Warning: WORLD_ENGINE slab only runs single explicit diffusion steps;"
+                          << " ignoring DIFFUSION_SOLVER, TEMPORAL_BLOCK_STEPS, ACTIVE_REGION and STEADY_STATE" << std::endl;
+      IMPLICIT_DIFFUSION = false;
+      TEMPORAL_BLOCK_STEPS = 1;
+      ACTIVE_REGION = false;
+      STEADY_STATE = false;
+    }
+    if (CHECKPOINT_INTERVAL > 0 || SNAPSHOT_FILE != "") {
+      if (root) std::cerr << "Warning: checkpoints and snapshots are not written with WORLD_ENGINE slab" << std::endl;
+      CHECKPOINT_INTERVAL = 0;
+      SNAPSHOT_FILE.clear();
+    }
+    const size_t num_blocks_z = (global_z + FATE_BLOCK - 1) / FATE_BLOCK;
+    if ((size_t)comm.GetSize() > num_blocks_z) {
+      if (root) std::cerr << "Error: a WORLD_Z of " << global_z << " can be split over at most " << num_blocks_z
+                          << " processes" << std::endl;
+      return false;
+    }
+
+    const int rank = comm.GetRank();
+    SlabRange(rank, comm.GetSize(), z_begin, z_end);
+    ghost_lo = rank > 0;
+    ghost_hi = rank + 1 < comm.GetSize();
+    lower = ghost_lo ? rank - 1 : SlabComm::NONE;
+    upper = ghost_hi ? rank + 1 : SlabComm::NONE;
+    plane_size = WORLD_X * WORLD_Y;
+    id_offset = (z_begin - ghost_lo) * plane_size;
+
+    WORLD_Z = z_end - z_begin + ghost_lo + ghost_hi;
+    neighbors.Setup(WORLD_X, WORLD_Y, WORLD_Z);
+    NewPublicGood();
+
+    if (!root) POPULATION_FILE.clear(); // The root writes the global counts
+
+    AllocateCells();
+    SetupSlabBlocks();
+    InitPublicGood();
+    InitSlabPop();
+    ExchangeCells();
+    return true;
+  }
+
+  int GetNumProcs() const {return comm.GetSize();}
+
+  /// Owned planes of this process, in global z
+  size_t GetZBegin() const {return z_begin;}
+  size_t GetZEnd() const {return z_end;}
+
+  /// Totals over every process (collective)
+  Stats GetGlobalStats() {
+    double totals[4] = {0, 0, 0, 0};
+    const size_t begin = ghost_lo * plane_size;
+    const size_t end = begin + (z_end - z_begin) * plane_size;
+    occupied_bits.ForEachSet(begin, end, [this, &totals](size_t cell_id){
+      totals[0] += 1;
+      totals[1] += producer_mask[cell_id];
+      totals[2] += resistance[cell_id];
+    });
+    for (size_t cell_id = begin; cell_id < end; cell_id++) {
+      totals[3] += GetCellPublicGood(cell_id);
+    }
+    comm.SumAll(totals, 4);
+    Stats total;
+    total.cells = totals[0];
+    total.producers = totals[1];
+    total.resistance = totals[2];
+    total.public_good = totals[3];
+    return total;
+  }
+
+  void RunStep() {
+    if (show_progress) Logger::Get().Progress(update);
+
+    HCA_PROFILE_BEGIN(CELL_FATES);
+    const uint64_t seed = (uint64_t)random_ptr->GetSeed();
+    parallel_step = true;
+    for (size_t color = 0; color < color_blocks.size(); color++) {
+      const emp::vector<size_t> & blocks = color_blocks[color];
+      thread_pool.ParallelFor(0, blocks.size(), [this, &blocks, seed](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++) {
+          UpdateSlabBlock(blocks[i], seed);
+        }
+      });
+      if (color % 9 == 8) {
+        // Last color of this z color; the next could overwrite these voxels
+        SendPlacements();
+      }
+    }
+    parallel_step = false;
+
+    HCA_PROFILE_END();
+    Update();
+    ProfileIfDue(update);
+  }
+
+  void Run() {
+    Logger::Get().StartProgress(update, (size_t)TIME_STEPS + 1);
+    for (int u = (int)update; u <= TIME_STEPS; u++) {
+      RunStep();
+    }
+    const Stats final_stats = GetGlobalStats();
+    Logger::Get().FinishProgress(update);
+    Logger::Get().Printf(Logger::SUMMARY, "%zu processes: %.0f cells, %.0f producers, mean resistance %g, mean public good %g",
+                         (size_t)comm.GetSize(), final_stats.cells, final_stats.producers,
+                         final_stats.cells > 0 ? final_stats.resistance / final_stats.cells : 0.0,
+                         final_stats.public_good / (double)(WORLD_X * WORLD_Y * global_z));
+    FinishProfile();
+  }
+
+  /// Whole state of the run, on the root (collective; the other processes
+  /// get an empty checkpoint). The root must hold the whole grid, so this
+  /// is for checking runs against HCAGridWorld on grids that fit.
+  Checkpoint GatherCheckpoint() {
+    const Checkpoint local = HCAGridWorld::GetCheckpoint();
+    const size_t begin = ghost_lo * plane_size;
+    const size_t end = begin + (z_end - z_begin) * plane_size;
+
+    std::vector<char> send;
+    auto append = [&send, begin, end](const auto & vals){
+      const char * first = reinterpret_cast<const char *>(vals.data() + begin);
+      send.insert(send.end(), first, first + (end - begin) * sizeof(vals[0]));
+    };
+    append(local.curr_field);
+    append(local.next_field);
+    append(local.occupied);
+    append(local.producer);
+    append(local.age);
+    append(local.resistance);
+
+    std::vector<char> all;
+    comm.Gather(send, all);
+    Checkpoint cp;
+    if (!comm.IsRoot()) return cp;
+
+    cp.Resize(WORLD_X, WORLD_Y, global_z);
+    cp.update = update;
+    cp.random_state = local.random_state;
+    const char * pos = all.data();
+    for (int rank = 0; rank < comm.GetSize(); rank++) {
+      size_t rank_begin, rank_end;
+      SlabRange(rank, comm.GetSize(), rank_begin, rank_end);
+      auto extract = [&pos, this, rank_begin, rank_end](auto & vals){
+        const size_t bytes = (rank_end - rank_begin) * plane_size * sizeof(vals[0]);
+        std::memcpy(reinterpret_cast<char *>(vals.data() + rank_begin * plane_size), pos, bytes);
+        pos += bytes;
+      };
+      extract(cp.curr_field);
+      extract(cp.next_field);
+      extract(cp.occupied);
+      extract(cp.producer);
+      extract(cp.age);
+      extract(cp.resistance);
+    }
+    return cp;
+  }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef _IMPLICIT_DIFFUSION_H
+#define _IMPLICIT_DIFFUSION_H
+
+#include <cstddef>
+#include <vector>
+
+namespace implicit {
+
+    /// Backward-Euler solve of (I - k * L) u = d along one axis of the grid,
+    /// where L is the 1D second difference with the same boundary handling
+    /// as the explicit stencil: a missing neighbor is the voxel itself
+    /// (no-flux), or the grid wraps around (toroidal). The matrix only
+    /// depends on the axis length, k and the boundary type, so the Thomas
+    /// factorization is computed once and then applied to many lines.
+    class LineSolver {
+        size_t n = 0;
+        double off = 0;              // Off-diagonal entry
+        bool cyclic = false;         // Needs the Sherman-Morrison correction
+        std::vector<double> inv;     // 1 / pivot
+        std::vector<double> c_prime; // Modified super-diagonal
+        std::vector<double> z;       // Solution of A' z = u (cyclic only)
+        double correction_scale = 0; // beta / gamma (cyclic only)
+        double correction_denom = 1; // 1 + z_0 + z_{n-1} beta / gamma (cyclic only)
+
+        void Factor(const std::vector<double> & diag) {
+            inv.resize(n);
+            c_prime.resize(n);
+            inv[0] = 1.0 / diag[0];
+            c_prime[0] = off * inv[0];
+            for (size_t i = 1; i < n; i++) {
+                inv[i] = 1.0 / (diag[i] - off * c_prime[i-1]);
+                c_prime[i] = off * inv[i];
+            }
+        }
+
+        /// Solve the (non-cyclic) factored system in place for @param count
+        /// lines. Element i of line j is at base[i * stride + j * line_stride].
+        template <typename T>
+        void Thomas(T * base, size_t stride, size_t count, size_t line_stride) const {
+            for (size_t j = 0; j < count; j++) {
+                base[j * line_stride] *= inv[0];
+            }
+            for (size_t i = 1; i < n; i++) {
+                T * cur = base + i * stride;
+                const T * prev = cur - stride;
+                for (size_t j = 0; j < count; j++) {
+                    cur[j * line_stride] = (cur[j * line_stride] - off * prev[j * line_stride]) * inv[i];
+                }
+            }
+            for (size_t i = n - 1; i-- > 0;) {
+                T * cur = base + i * stride;
+                const T * next = cur + stride;
+                for (size_t j = 0; j < count; j++) {
+                    cur[j * line_stride] -= c_prime[i] * next[j * line_stride];
+                }
+            }
+        }
+
+        public:
+        LineSolver() {;}
+
+        /// Set up for an axis of @param length voxels and coefficient @param k
+        /// (diffusion coefficient times the number of explicit steps covered).
+        void Setup(size_t length, double k, bool toroidal) {
+            n = length;
+            cyclic = false;
+            off = -k;
+            std::vector<double> diag(n, 1.0 + 2.0 * k);
+
+            if (n == 1) {
+                // Both neighbors are the voxel itself in either mode
+                diag[0] = 1.0;
+                off = 0;
+            } else if (!toroidal) {
+                diag[0] = 1.0 + k;
+                diag[n-1] = 1.0 + k;
+            } else if (n == 2) {
+                // Both neighbors of each voxel are the other voxel
+                off = -2.0 * k;
+            } else {
+                // Cyclic system: solve with A' = A - u v^T (Numerical Recipes
+                // cyclic tridiagonal), where gamma = -diag
+                cyclic = true;
+                const double b = 1.0 + 2.0 * k;
+                const double gamma = -b;
+                const double alpha = off; // A[n-1][0]
+                const double beta = off;  // A[0][n-1]
+                diag[0] = b - gamma;
+                diag[n-1] = b - alpha * beta / gamma;
+                Factor(diag);
+
+                z.assign(n, 0.0);
+                z[0] = gamma;
+                z[n-1] = alpha;
+                Thomas(z.data(), 1, 1, 1);
+                correction_scale = beta / gamma;
+                correction_denom = 1.0 + z[0] + correction_scale * z[n-1];
+                return;
+            }
+            Factor(diag);
+        }
+
+        /// Solve in place for @param count lines laid out as in Thomas().
+        /// Lines that are contiguous (line_stride 1) are solved together so
+        /// that the inner loops vectorize. The field can be stored as float;
+        /// the factorization is always double.
+        template <typename T>
+        void Solve(T * base, size_t stride, size_t count, size_t line_stride) const {
+            Thomas(base, stride, count, line_stride);
+            if (!cyclic) return;
+
+            std::vector<double> fact(count);
+            for (size_t j = 0; j < count; j++) {
+                fact[j] = (base[j * line_stride] + correction_scale * base[(n - 1) * stride + j * line_stride])
+                          / correction_denom;
+            }
+            for (size_t i = 0; i < n; i++) {
+                T * cur = base + i * stride;
+                for (size_t j = 0; j < count; j++) {
+                    cur[j * line_stride] -= fact[j] * z[i];
+                    // Subtracting the correction can undershoot zero by rounding
+                    if (cur[j * line_stride] < 0) cur[j * line_stride] = 0;
+                }
+            }
+        }
+    };
+}
+
+#endif
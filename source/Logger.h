@@ -0,0 +1,250 @@
+#ifndef _Logger_H
+#define _Logger_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// Buffered log for run output on stdout (configuration, progress), so
+/// that the simulation never waits on the terminal or a batch system's
+/// output file. Messages go into a fixed ring of slots that any thread can
+/// fill without taking a lock; a background thread writes them out in
+/// batches and flushes once per batch. Warnings and errors still go
+/// straight to std::cerr.
+///
+/// Levels: QUIET prints nothing, SUMMARY the configuration and a final
+/// timing line, PROGRESS adds a line with rate and ETA at most every
+/// progress interval, and UPDATES a line for every update.
+///
+/// Without threads (Emscripten) messages are written immediately.
+class Logger {
+    public:
+    enum Level : int {QUIET = 0, SUMMARY = 1, PROGRESS = 2, UPDATES = 3};
+
+    private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t NUM_SLOTS = 1024; // Power of two
+    static constexpr size_t SLOT_TEXT = 240;
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        uint32_t len;
+        char text[SLOT_TEXT];
+    };
+
+    Slot slots[NUM_SLOTS];
+    alignas(64) std::atomic<size_t> head{0};    // Next slot to fill
+    alignas(64) std::atomic<size_t> written{0}; // Slots written out so far
+
+    std::thread worker;
+    std::mutex mutex;           // Only for sleeping and waking the worker
+    std::condition_variable cv;
+    std::atomic<bool> stopping{false};
+
+    int level = PROGRESS;
+    double progress_interval = 1.0;
+
+    // Progress of the current Run()
+    clock::time_point start_time, last_report_time;
+    size_t first_update = 0, end_update = 0, last_report_update = 0;
+    std::string unit = "update";
+    bool in_run = false;
+
+    Logger() {
+        for (size_t i = 0; i < NUM_SLOTS; i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+#ifndef __EMSCRIPTEN__
+        worker = std::thread([this](){ WorkerLoop(); });
+#endif
+    }
+
+    /// Claim a slot, copy @param len bytes of @param text into it and
+    /// publish it. Returns false if the ring is full.
+    bool TryPush(const char * text, size_t len) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Slot * slot;
+        while (true) {
+            slot = &slots[pos & (NUM_SLOTS - 1)];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const long diff = (long)seq - (long)pos;
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        std::memcpy(slot->text, text, len);
+        slot->len = (uint32_t)len;
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Push(const char * text, size_t len) {
+#ifdef __EMSCRIPTEN__
+        std::fwrite(text, 1, len, stdout);
+#else
+        while (!TryPush(text, len)) {
+            cv.notify_one();
+            std::this_thread::yield();
+        }
+#endif
+    }
+
+    /// Write out every published slot; returns how many there were
+    size_t Drain() {
+        size_t pos = written.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (true) {
+            Slot & slot = slots[pos & (NUM_SLOTS - 1)];
+            if (slot.seq.load(std::memory_order_acquire) != pos + 1) break;
+            std::fwrite(slot.text, 1, slot.len, stdout);
+            slot.seq.store(pos + NUM_SLOTS, std::memory_order_release);
+            pos++;
+            count++;
+        }
+        if (count) {
+            std::fflush(stdout);
+            written.store(pos, std::memory_order_release);
+        }
+        return count;
+    }
+
+    void WorkerLoop() {
+        while (true) {
+            if (Drain()) continue;
+            if (stopping.load(std::memory_order_acquire)) {
+                Drain();
+                return;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(20));
+        }
+    }
+
+    static double Seconds(clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    static std::string FormatTime(double seconds) {
+        const long total = (long)(seconds + 0.5);
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%ld:%02ld:%02ld", total / 3600, (total / 60) % 60, total % 60);
+        return buf;
+    }
+
+    public:
+    Logger(const Logger &) = delete;
+    Logger & operator=(const Logger &) = delete;
+
+    ~Logger() {
+        stopping.store(true, std::memory_order_release);
+        cv.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    /// The process-wide log
+    static Logger & Get() {
+        static Logger logger;
+        return logger;
+    }
+
+    void SetLevel(int in_level) {level = in_level;}
+    int GetLevel() const {return level;}
+    bool Enabled(int at_level) const {return level >= at_level;}
+
+    /// Minimum @param seconds between progress lines
+    void SetProgressInterval(double seconds) {progress_interval = seconds;}
+
+    /// Print @param text (which should end in a newline) at @param at_level.
+    /// Long text is split over several slots.
+    void Write(int at_level, const std::string & text) {
+        if (!Enabled(at_level)) return;
+        for (size_t pos = 0; pos < text.size(); pos += SLOT_TEXT) {
+            Push(text.data() + pos, std::min(SLOT_TEXT, text.size() - pos));
+        }
+    }
+
+    /// printf-style line at @param at_level; the newline is added here.
+    /// Formats straight into the message, without allocating.
+    void Printf(int at_level, const char * format, ...) {
+        if (!Enabled(at_level)) return;
+        char buf[SLOT_TEXT];
+        va_list args;
+        va_start(args, format);
+        int len = std::vsnprintf(buf, SLOT_TEXT - 1, format, args);
+        va_end(args);
+        if (len < 0) return;
+        len = std::min(len, (int)SLOT_TEXT - 2);
+        buf[len] = '\n';
+        Push(buf, (size_t)len + 1);
+    }
+
+    /// Block until everything logged so far has been written
+    void Flush() {
+#ifndef __EMSCRIPTEN__
+        const size_t target = head.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target) {
+            cv.notify_one();
+            std::this_thread::yield();
+        }
+#else
+        std::fflush(stdout);
+#endif
+    }
+
+    /// A run over updates (or other steps, named by @param in_unit)
+    /// [@param first, @param end) is starting
+    void StartProgress(size_t first, size_t end, const std::string & in_unit = "update") {
+        unit = in_unit;
+        start_time = last_report_time = clock::now();
+        first_update = last_report_update = first;
+        end_update = end;
+        in_run = true;
+    }
+
+    /// Update @param update is starting
+    void Progress(size_t update) {
+        if (Enabled(UPDATES)) {
+            Printf(UPDATES, "%zu", update);
+            return;
+        }
+        if (!in_run || !Enabled(PROGRESS)) return;
+
+        const clock::time_point now = clock::now();
+        const double since_report = Seconds(now - last_report_time);
+        if (since_report < progress_interval) return;
+
+        const double rate = (double)(update - last_report_update) / since_report;
+        const double overall_rate = (double)(update - first_update) / Seconds(now - start_time);
+        const double eta = overall_rate > 0 ? (double)(end_update - update) / overall_rate : 0;
+        Printf(PROGRESS, "%s %zu/%zu (%.1f %ss/s, ETA %s)", unit.c_str(), update, end_update,
+               rate, unit.c_str(), FormatTime(eta).c_str());
+        last_report_time = now;
+        last_report_update = update;
+    }
+
+    /// The run ended before update @param update
+    void FinishProgress(size_t update) {
+        if (!in_run) return;
+        in_run = false;
+        const double elapsed = Seconds(clock::now() - start_time);
+        Printf(SUMMARY, "Finished %zu %ss in %.2f s (%.1f %ss/s)", update - first_update, unit.c_str(), elapsed,
+               elapsed > 0 ? (double)(update - first_update) / elapsed : 0.0, unit.c_str());
+        Flush();
+    }
+};
+
+#endif
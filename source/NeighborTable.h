@@ -0,0 +1,101 @@
+#ifndef _NeighborTable_H
+#define _NeighborTable_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Precomputed Moore (26-voxel) neighborhoods on a non-wrapping 3D grid
+/// laid out x-fastest. Each voxel is classified by which faces of the grid
+/// it touches along each axis; the class selects a mask of the offsets
+/// that stay inside the grid, so looking up neighbors needs no coordinate
+/// math or bounds checks.
+///
+/// Neighbors are numbered in the order of the original CanDivide loops
+/// (x outermost, then y, then z), so that choosing the k-th open neighbor
+/// gives the same voxel as before.
+class NeighborTable {
+    public:
+    static constexpr size_t MAX_NEIGHBORS = 26;
+
+    private:
+    // Per axis: 0 = interior, 1 = on the low face, 2 = on the high face,
+    // 3 = on both (axis of length 1)
+    static constexpr size_t NUM_CLASSES = 4 * 4 * 4;
+
+    long offsets[MAX_NEIGHBORS];
+    long row_stride = 0;   // Distance between (x, y, z) and (x, y+1, z)
+    long plane_stride = 0; // Distance between (x, y, z) and (x, y, z+1)
+    uint32_t class_masks[NUM_CLASSES]; // Bit i set if offsets[i] is in the grid
+    std::vector<unsigned char> voxel_class;
+
+    static unsigned char AxisClass(size_t coord, size_t len) {
+        unsigned char c = 0;
+        if (coord == 0) c |= 1;
+        if (coord + 1 == len) c |= 2;
+        return c;
+    }
+
+    public:
+    NeighborTable() {;}
+
+    void Setup(size_t x_len, size_t y_len, size_t z_len) {
+        const long row = (long)x_len;
+        const long plane = (long)(x_len * y_len);
+        row_stride = row;
+        plane_stride = plane;
+
+        for (size_t c = 0; c < NUM_CLASSES; c++) {
+            class_masks[c] = 0;
+        }
+
+        size_t i = 0;
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    if (dx == 0 && dy == 0 && dz == 0) {
+                        continue; // The focal cell is never open
+                    }
+                    offsets[i] = dx + dy * row + dz * plane;
+                    for (size_t c = 0; c < NUM_CLASSES; c++) {
+                        const size_t cx = c >> 4;
+                        const size_t cy = (c >> 2) & 3;
+                        const size_t cz = c & 3;
+                        const bool outside = (dx < 0 && (cx & 1)) || (dx > 0 && (cx & 2))
+                                          || (dy < 0 && (cy & 1)) || (dy > 0 && (cy & 2))
+                                          || (dz < 0 && (cz & 1)) || (dz > 0 && (cz & 2));
+                        if (!outside) class_masks[c] |= 1u << i;
+                    }
+                    i++;
+                }
+            }
+        }
+
+        voxel_class.resize(x_len * y_len * z_len);
+        size_t cell_id = 0;
+        for (size_t z = 0; z < z_len; z++) {
+            const unsigned char cz = AxisClass(z, z_len);
+            for (size_t y = 0; y < y_len; y++) {
+                const unsigned char cy = AxisClass(y, y_len);
+                for (size_t x = 0; x < x_len; x++) {
+                    voxel_class[cell_id++] = (AxisClass(x, x_len) << 4) | (cy << 2) | cz;
+                }
+            }
+        }
+    }
+
+    /// Bit i is set if neighbor i of @param cell_id is inside the grid
+    uint32_t GetMask(size_t cell_id) const {
+        return class_masks[voxel_class[cell_id]];
+    }
+
+    long GetRowStride() const {return row_stride;}
+    long GetPlaneStride() const {return plane_stride;}
+
+    /// Voxel id of neighbor @param i of @param cell_id
+    size_t GetNeighbor(size_t cell_id, size_t i) const {
+        return (size_t)((long)cell_id + offsets[i]);
+    }
+};
+
+#endif
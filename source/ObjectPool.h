@@ -0,0 +1,129 @@
+#ifndef _ObjectPool_H
+#define _ObjectPool_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/// Recycles storage for objects of type T. Released blocks go onto a free
+/// list and are handed straight back out by the next Allocate(), so once a
+/// population has reached its working size no more memory is requested
+/// from the system. New storage is carved out of slabs of SLAB_SIZE blocks.
+///
+/// Each thread allocates from its own pool (Local()), without locking.
+/// Every block remembers the pool it came from, and Release() hands it
+/// back to that pool from whichever thread frees it: straight onto the
+/// free list on the owning thread, otherwise onto a lock-free list that
+/// the owner takes over once its own free list runs dry. Cells set up on
+/// one thread and run on another (the web interface's simulation thread,
+/// the grid engine's workers) are therefore safe to free anywhere. A pool
+/// whose thread has exited lives on until its last block is released.
+template <typename T, size_t SLAB_SIZE = 4096>
+class ObjectPool {
+    struct Block {
+        ObjectPool * owner;
+        union {
+            Block * next; // While on a free list
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+    };
+
+    std::vector<Block *> slabs;
+    Block * free_list = nullptr;
+    size_t slab_used = SLAB_SIZE;           // Blocks handed out from slabs.back()
+    std::atomic<Block *> remote_free{nullptr}; // Released on other threads
+    std::atomic<size_t> refs{1};            // Live blocks, plus one while the owning thread runs
+
+    // The calling thread's pool, if it has one. A plain pointer, so that
+    // it is still safe to read while the thread's other thread_local
+    // objects (which may hold pooled objects) are being destroyed.
+    static ObjectPool *& CurrentPool() {
+        thread_local ObjectPool * current = nullptr;
+        return current;
+    }
+
+    // Drops the owning thread's reference when the thread exits
+    struct Owner {
+        ObjectPool * pool = new ObjectPool;
+        Owner() {CurrentPool() = pool;}
+        ~Owner() {
+            CurrentPool() = nullptr;
+            pool->Unref();
+        }
+    };
+
+    ObjectPool() {;}
+
+    ~ObjectPool() {
+        for (Block * slab : slabs) {
+            delete [] slab;
+        }
+    }
+
+    void Unref() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    static Block * BlockOf(void * ptr) {
+        return reinterpret_cast<Block *>(static_cast<unsigned char *>(ptr) - offsetof(Block, storage));
+    }
+
+    public:
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool & operator=(const ObjectPool &) = delete;
+
+    /// Storage for one T. Only call on the pool's own thread (see Local()).
+    void * Allocate() {
+        refs.fetch_add(1, std::memory_order_relaxed);
+        if (!free_list) {
+            free_list = remote_free.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (free_list) {
+            Block * block = free_list;
+            free_list = block->next;
+            return block->storage;
+        }
+        if (slab_used == SLAB_SIZE) {
+            slabs.push_back(new Block[SLAB_SIZE]);
+            slab_used = 0;
+        }
+        Block * block = &slabs.back()[slab_used++];
+        block->owner = this;
+        return block->storage;
+    }
+
+    /// Give @param ptr (from Allocate() on any thread's pool) back to the
+    /// pool it came from. May be called on any thread.
+    static void Release(void * ptr) {
+        if (!ptr) return;
+        Block * block = BlockOf(ptr);
+        ObjectPool * owner = block->owner;
+        if (owner == CurrentPool()) {
+            block->next = owner->free_list;
+            owner->free_list = block;
+        } else {
+            Block * head = owner->remote_free.load(std::memory_order_relaxed);
+            do {
+                block->next = head;
+            } while (!owner->remote_free.compare_exchange_weak(head, block, std::memory_order_release,
+                                                               std::memory_order_relaxed));
+        }
+        owner->Unref();
+    }
+
+    /// Number of blocks from this pool currently allocated and not yet
+    /// released, on any thread
+    size_t GetNumLive() const {return refs.load(std::memory_order_acquire) - 1;}
+
+    /// Number of blocks the pool can hold without allocating another slab
+    size_t GetCapacity() const {return slabs.size() * SLAB_SIZE;}
+
+    /// The calling thread's pool
+    static ObjectPool & Local() {
+        thread_local Owner owner;
+        return *owner.pool;
+    }
+};
+
+#endif
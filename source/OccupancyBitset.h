@@ -0,0 +1,135 @@
+#ifndef _OccupancyBitset_H
+#define _OccupancyBitset_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "NeighborTable.h"
+
+/// One bit per voxel marking which voxels hold a cell. Scans work a 64-bit
+/// word at a time, so sweeps over a sparse population skip empty space at
+/// 64 voxels per instruction instead of testing every voxel.
+class OccupancyBitset {
+    std::vector<uint64_t> words;
+    size_t num_bits = 0;
+
+    public:
+    OccupancyBitset() {;}
+
+    /// Resize to @param n voxels, all empty
+    void Resize(size_t n) {
+        num_bits = n;
+        words.assign((n + 63) / 64, 0);
+    }
+
+    /// Mark every voxel empty
+    void Clear() {
+        std::fill(words.begin(), words.end(), 0);
+    }
+
+    size_t size() const {return num_bits;}
+
+    bool Test(size_t i) const {return (words[i >> 6] >> (i & 63)) & 1;}
+    void Set(size_t i) {words[i >> 6] |= uint64_t(1) << (i & 63);}
+    void Reset(size_t i) {words[i >> 6] &= ~(uint64_t(1) << (i & 63));}
+
+    /// Set() that is safe to call concurrently for voxels in the same word
+    void SetAtomic(size_t i) {
+        __atomic_fetch_or(&words[i >> 6], uint64_t(1) << (i & 63), __ATOMIC_RELAXED);
+    }
+
+    void Swap(OccupancyBitset & other) {
+        words.swap(other.words);
+        std::swap(num_bits, other.num_bits);
+    }
+
+    /// Number of occupied voxels
+    size_t Count() const {
+        size_t count = 0;
+        for (uint64_t word : words) {
+            count += (size_t)__builtin_popcountll(word);
+        }
+        return count;
+    }
+
+    /// First occupied voxel at or after @param i, or size() if there is none
+    size_t FindNext(size_t i) const {
+        if (i >= num_bits) return num_bits;
+        size_t w = i >> 6;
+        uint64_t word = words[w] & (~uint64_t(0) << (i & 63));
+        while (!word) {
+            if (++w == words.size()) return num_bits;
+            word = words[w];
+        }
+        const size_t found = (w << 6) + (size_t)__builtin_ctzll(word);
+        return found < num_bits ? found : num_bits;
+    }
+
+    /// Call @param fn(i) for every occupied voxel i in [begin, end), in order
+    template <typename FUN>
+    void ForEachSet(size_t begin, size_t end, const FUN & fn) const {
+        for (size_t i = FindNext(begin); i < end; i = FindNext(i + 1)) {
+            fn(i);
+        }
+    }
+
+    /// Bits [@param first, first + 3) as the low three bits of the result,
+    /// from at most two word loads. Bits outside the bitset read as 0.
+    uint32_t ThreeBits(long first) const {
+        if (first < -2 || first >= (long)num_bits) return 0;
+        const long w = (first + 64) / 64 - 1; // Rounded down, for first < 0 too
+        const unsigned shift = (unsigned)(first - w * 64);
+        uint64_t bits = w >= 0 ? words[(size_t)w] >> shift : 0;
+        if (shift > 61 && (size_t)(w + 1) < words.size()) {
+            bits |= words[(size_t)(w + 1)] << (64 - shift);
+        }
+        return (uint32_t)(bits & 7);
+    }
+
+    /// Mask (bit i for neighbor i of @param table) of the in-grid neighbors
+    /// of @param cell_id that are empty. The three x-neighbors in each of
+    /// the nine (dy, dz) rows around the voxel are adjacent bits, so each
+    /// row takes one ThreeBits() load; the rows' bits are then spread into
+    /// the table's neighbor order (dx outermost, then dy, then dz) and
+    /// masked by the neighbors that are inside the grid.
+    uint32_t EmptyNeighbors(const NeighborTable & table, size_t cell_id) const {
+        const long row = table.GetRowStride();
+        const long plane = table.GetPlaneStride();
+        uint32_t occupied = 0; // Bit (dx + 1) * 9 + (dy + 1) * 3 + (dz + 1), focal voxel included
+        size_t j = 0;          // (dy + 1) * 3 + (dz + 1)
+        for (long dy = -1; dy <= 1; dy++) {
+            for (long dz = -1; dz <= 1; dz++, j++) {
+                const uint32_t bits = ThreeBits((long)cell_id + dy * row + dz * plane - 1);
+                occupied |= (bits & 1) << j | ((bits >> 1) & 1) << (9 + j) | (bits >> 2) << (18 + j);
+            }
+        }
+        // Drop the focal voxel (bit 13) to get the table's 26 neighbors
+        const uint32_t neighbors = (occupied & 0x1fff) | (occupied >> 14) << 13;
+        return table.GetMask(cell_id) & ~neighbors;
+    }
+
+    static size_t CountBits(uint32_t mask) {
+        return (size_t)__builtin_popcount(mask);
+    }
+
+    /// Index of the @param k th (from 0) set bit of @param mask
+    static size_t SelectBit(uint32_t mask, size_t k) {
+#if defined(__BMI2__)
+        return (size_t)__builtin_ctz(_pdep_u32(1u << k, mask));
+#else
+        for (size_t j = 0; j < k; j++) {
+            mask &= mask - 1;
+        }
+        return (size_t)__builtin_ctz(mask);
+#endif
+    }
+};
+
+#endif
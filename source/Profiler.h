@@ -0,0 +1,242 @@
+#ifndef _Profiler_H
+#define _Profiler_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+
+/// Time spent in each phase of an update, and counts of cell events.
+/// Phases nest (the public good update runs inside the world update, for
+/// example); each phase's self time excludes the phases nested in it, so
+/// self times add up to the time covered by the outermost phases.
+///
+/// Timers and counters are only compiled in with HCA_PROFILE defined;
+/// otherwise the HCA_PROFILE_* macros expand to nothing. HCA_PROFILE_SCOPE
+/// times the rest of the enclosing block; HCA_PROFILE_BEGIN/END bracket a
+/// stretch of code that is not a block of its own. Scopes must only
+/// be opened on the thread that runs the model (never inside ParallelFor
+/// bodies); counters may be bumped from any thread.
+///
+/// Systematics have no hook of their own: emp::World updates them as
+/// cells are placed and replaced, so their cost is part of cell_fates and
+/// world_update.
+class Profiler {
+    public:
+    enum Phase : int {
+        CELL_FATES,   // Death, division or quiescence of every cell
+        WORLD_UPDATE, // Data files, generation swap and systematics
+        PUBLIC_GOOD,  // Public good update, outside its sub-phases
+        CELL_MASKS,   // Rebuilding the per-voxel cell masks
+        CONSUMPTION,  // Basal consumption by cells
+        DIFFUSION,    // Diffusion sweeps (with sources, on fused paths)
+        SOURCES,      // Production, decay and clamping on their own passes
+        OUTPUT,       // Handing checkpoints and snapshots to their writers
+        NUM_PHASES
+    };
+
+    enum Counter : int {DIVISIONS, DEATHS, QUIESCENCES, CELL_ALLOCATIONS, NUM_COUNTERS};
+
+#ifdef HCA_PROFILE
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t MAX_DEPTH = 16;
+    static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+    struct Totals {
+        double self_s[NUM_PHASES] = {0};
+        double total_s[NUM_PHASES] = {0};
+        uint64_t calls[NUM_PHASES] = {0};
+        uint64_t counts[NUM_COUNTERS] = {0};
+    };
+
+    struct Frame {
+        Phase phase;
+        clock::time_point start;
+        double child_s;
+    };
+
+    struct TraceEvent {
+        Phase phase;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    Totals totals;
+    Totals last_report;
+    size_t last_report_update = 0;
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+
+    Frame stack[MAX_DEPTH];
+    size_t depth = 0;
+
+    clock::time_point origin = clock::now();
+    std::string trace_file;
+    std::vector<TraceEvent> trace;
+
+    Profiler() {
+        for (size_t c = 0; c < NUM_COUNTERS; c++) {
+            counters[c].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Totals Snapshot() const {
+        Totals t = totals;
+        for (size_t c = 0; c < NUM_COUNTERS; c++) {
+            t.counts[c] = counters[c].load(std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    public:
+    Profiler(const Profiler &) = delete;
+    Profiler & operator=(const Profiler &) = delete;
+
+    /// The process-wide profile
+    static Profiler & Get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static const char * PhaseName(int phase) {
+        static const char * names[NUM_PHASES] = {"cell_fates", "world_update", "public_good", "cell_masks",
+                                                 "consumption", "diffusion", "sources", "output"};
+        return names[phase];
+    }
+
+    static const char * CounterName(int counter) {
+        static const char * names[NUM_COUNTERS] = {"divisions", "deaths", "quiescences", "cell_allocations"};
+        return names[counter];
+    }
+
+    /// Also record every phase as a Chrome trace event (viewable in
+    /// chrome://tracing or Perfetto), written to @param filename by
+    /// WriteTrace()
+    void SetTraceFile(const std::string & filename) {trace_file = filename;}
+
+    void Begin(Phase phase) {
+        if (depth < MAX_DEPTH) {
+            stack[depth] = {phase, clock::now(), 0};
+        }
+        depth++;
+    }
+
+    void End() {
+        depth--;
+        if (depth >= MAX_DEPTH) return;
+        const Frame & frame = stack[depth];
+        const clock::time_point now = clock::now();
+        const double elapsed = std::chrono::duration<double>(now - frame.start).count();
+        totals.self_s[frame.phase] += elapsed - frame.child_s;
+        totals.total_s[frame.phase] += elapsed;
+        totals.calls[frame.phase]++;
+        if (depth > 0 && depth <= MAX_DEPTH) {
+            stack[depth - 1].child_s += elapsed;
+        }
+        if (!trace_file.empty() && trace.size() < MAX_TRACE_EVENTS) {
+            trace.push_back({frame.phase,
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(frame.start - origin).count(),
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(now - frame.start).count()});
+        }
+    }
+
+    void Count(Counter counter, uint64_t n = 1) {
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /// Times one phase for as long as it is in scope
+    class Scope {
+        public:
+        Scope(Phase phase) {Profiler::Get().Begin(phase);}
+        ~Scope() {Profiler::Get().End();}
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+
+    /// One line with each phase's share of the self time since the last
+    /// call, and the event counts, ending at @param update
+    void ReportInterval(size_t update) {
+        if (!ENABLED || !Logger::Get().Enabled(Logger::PROGRESS)) return;
+        const Totals now = Snapshot();
+        double sum = 0;
+        for (size_t p = 0; p < NUM_PHASES; p++) {
+            sum += now.self_s[p] - last_report.self_s[p];
+        }
+
+        std::string line = "profile " + std::to_string(last_report_update) + "-" + std::to_string(update) + ":";
+        char buf[64];
+        for (size_t p = 0; p < NUM_PHASES; p++) {
+            const double self = now.self_s[p] - last_report.self_s[p];
+            std::snprintf(buf, sizeof(buf), " %s %.1f%%", PhaseName((int)p), sum > 0 ? 100 * self / sum : 0.0);
+            line += buf;
+        }
+        for (size_t c = 0; c < NUM_COUNTERS; c++) {
+            line += std::string(" ") + CounterName((int)c) + " " + std::to_string(now.counts[c] - last_report.counts[c]);
+        }
+        Logger::Get().Write(Logger::PROGRESS, line + "\n");
+        last_report = now;
+        last_report_update = update;
+    }
+
+    /// Table of the whole run's phases and counts
+    void ReportTotals() {
+        if (!ENABLED || !Logger::Get().Enabled(Logger::SUMMARY)) return;
+        const Totals now = Snapshot();
+        double sum = 0;
+        for (size_t p = 0; p < NUM_PHASES; p++) {
+            sum += now.self_s[p];
+        }
+
+        Logger & log = Logger::Get();
+        log.Printf(Logger::SUMMARY, "%-16s %10s %12s %12s %7s", "phase", "calls", "total s", "self s", "self %");
+        for (size_t p = 0; p < NUM_PHASES; p++) {
+            log.Printf(Logger::SUMMARY, "%-16s %10llu %12.4f %12.4f %6.1f%%", PhaseName((int)p),
+                       (unsigned long long)now.calls[p], now.total_s[p], now.self_s[p],
+                       sum > 0 ? 100 * now.self_s[p] / sum : 0.0);
+        }
+        for (size_t c = 0; c < NUM_COUNTERS; c++) {
+            log.Printf(Logger::SUMMARY, "%-16s %10llu", CounterName((int)c), (unsigned long long)now.counts[c]);
+        }
+    }
+
+    /// Write the recorded phases to the trace file, if one was set
+    bool WriteTrace() const {
+        if (trace_file.empty()) return true;
+        std::ofstream out(trace_file);
+        if (!out) return false;
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        for (size_t i = 0; i < trace.size(); i++) {
+            const TraceEvent & e = trace[i];
+            out << "{\"name\": \"" << PhaseName(e.phase) << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": "
+                << (double)e.start_ns / 1000 << ", \"dur\": " << (double)e.duration_ns / 1000 << "}"
+                << (i + 1 < trace.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        return (bool)out;
+    }
+};
+
+#ifdef HCA_PROFILE
+#define HCA_PROFILE_SCOPE(PHASE) Profiler::Scope profile_scope(Profiler::PHASE)
+#define HCA_PROFILE_BEGIN(PHASE) Profiler::Get().Begin(Profiler::PHASE)
+#define HCA_PROFILE_END() Profiler::Get().End()
+#define HCA_PROFILE_COUNT(COUNTER) Profiler::Get().Count(Profiler::COUNTER)
+#else
+#define HCA_PROFILE_SCOPE(PHASE)
+#define HCA_PROFILE_BEGIN(PHASE)
+#define HCA_PROFILE_END()
+#define HCA_PROFILE_COUNT(COUNTER)
+#endif
+
+#endif
@@ -1,128 +1,304 @@
 #ifndef _RESOURCE_GRADIENT_H
 #define _RESOURCE_GRADIENT_H
 
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
 #include "base/vector.h"
 
-class ResourceGradient {
-    using grid_t = emp::vector<emp::vector<emp::vector<double> > >; // It might be possible to make these arrays
-    grid_t curr_grid;
-    grid_t next_grid;
-    double diffusion_coefficient;
+#include "AlignedBuffer.h"
+#include "DiffusionKernels.h"
+#include "ImplicitDiffusion.h"
+
+/// A diffusing field on a 3D (or 2D, with z_len 1) grid, stored as T
+/// (double or float). Values go in and out as double; float halves the
+/// memory and doubles the vector width of the diffusion kernels.
+///
+/// The grid can hold several fields (e.g. further goods or a drug), each
+/// with its own diffusion coefficient. They are interleaved a row at a
+/// time, so that FusedUpdateFields() updates all of them in one sweep.
+/// Field 0 is the primary one: every method that does not take a field
+/// argument reads or updates field 0 only.
+template <typename T>
+class BasicResourceGradient {
+    using grid_t = emp::vector<emp::vector<emp::vector<double> > >;
+
+    // Each grid is a single contiguous buffer laid out x-fastest. Rows are
+    // padded out to a whole number of cache lines so that every row starts
+    // aligned; padding cells are always zero and never read by the stencil.
+    // With several fields, each (y, z) row holds one such padded row per
+    // field, field 0 first.
+    AlignedBuffer<T> curr_grid;
+    AlignedBuffer<T> next_grid;
+    AlignedBuffer<T> scratch_grid; // Output of FusedUpdate; empty until first used
+    emp::vector<double> diffusion_coefficients; // One per field
     size_t x_len;
     size_t y_len;
     size_t z_len;
+    size_t num_fields;
+    size_t field_stride; // Distance between a voxel of field f and of field f+1
+    size_t row_stride;   // Distance between (x, y, z) and (x, y+1, z)
+    size_t plane_stride; // Distance between (x, y, z) and (x, y, z+1)
     bool toroidal;
+    bool compensated = false; // Compensated summation in the stencil
+
+    // One solver per axis for the implicit scheme, set up by SetupImplicit()
+    implicit::LineSolver x_solver;
+    implicit::LineSolver y_solver;
+    implicit::LineSolver z_solver;
+
+    // Per-row flags for FusedUpdateActive(), empty unless TrackActiveRows()
+    // has been called. A row whose flag is clear is known to be all zero.
+    emp::vector<unsigned char> curr_live;    // Row of curr_grid
+    emp::vector<unsigned char> scratch_live; // Row of scratch_grid
+    emp::vector<unsigned char> source_live;  // Row of next_grid (pending sources)
+    double active_epsilon = 0;
+
+    // Per-row state for FusedUpdateSteady(), empty unless TrackSteadyRows()
+    // has been called. A frozen row holds the same values in curr_grid and
+    // scratch_grid and is not updated.
+    emp::vector<unsigned char> curr_moved;     // Some field changed by more than steady_epsilon in the step that made the row of curr_grid
+    emp::vector<unsigned char> scratch_moved;  // Row of scratch_grid
+    emp::vector<unsigned char> curr_frozen;    // Row of curr_grid
+    emp::vector<unsigned char> scratch_frozen; // Row of scratch_grid
+    emp::vector<unsigned char> steady_hold;    // Steps the row has to be updated for before it may freeze
+    emp::vector<unsigned char> steady_occupied; // Masks the rows were last updated with, in cell id order
+    emp::vector<unsigned char> steady_producer;
+    double steady_epsilon = 0;
+    static constexpr size_t STEADY_CHUNK_ROWS = 16; // Rows updated before checking how far they moved
+
+    bool RowIsZero(const AlignedBuffer<T> & grid, size_t r) const {
+        if (grid.size() == 0) return true;
+        const T * row = grid.data() + (r / y_len) * plane_stride + (r % y_len) * row_stride;
+        for (size_t x = 0; x < x_len; x++) {
+            if (row[x] != 0) return false;
+        }
+        return true;
+    }
+
+    void Allocate() {
+        const size_t row_align = AlignedBuffer<T>::ALIGNMENT / sizeof(T);
+        field_stride = ((x_len + row_align - 1) / row_align) * row_align;
+        row_stride = field_stride * num_fields;
+        plane_stride = row_stride * y_len;
+        curr_grid.Resize(plane_stride * z_len);
+        next_grid.Resize(plane_stride * z_len);
+    }
+
+    /// Call @param fn(dims, compensated) with std::integral_constant
+    /// arguments selecting the stencil kernel instantiation for this grid
+    template <typename FN>
+    void WithKernel(FN && fn) {
+        using flat = std::integral_constant<size_t, 2>;
+        using deep = std::integral_constant<size_t, 3>;
+        if (IsFlat()) {
+            if (compensated) fn(flat(), std::true_type());
+            else fn(flat(), std::false_type());
+        } else {
+            if (compensated) fn(deep(), std::true_type());
+            else fn(deep(), std::false_type());
+        }
+    }
 
     public:
-    ResourceGradient(size_t x_len_in, size_t y_len_in=1, size_t z_len_in=1) :
-        diffusion_coefficient(0),
+    using value_t = T;
+
+    BasicResourceGradient(size_t x_len_in, size_t y_len_in=1, size_t z_len_in=1, size_t num_fields_in=1) :
+        diffusion_coefficients(std::max(num_fields_in, (size_t)1), 0.0),
         x_len(x_len_in), y_len(y_len_in), z_len(z_len_in),
+        num_fields(std::max(num_fields_in, (size_t)1)),
         toroidal(false) {
-        curr_grid.resize(z_len);
-        next_grid.resize(z_len);
-
-        for (size_t z = 0; z < z_len; z++) {
-            curr_grid[z].resize(y_len);
-            next_grid[z].resize(y_len);
-            for (size_t y = 0; y < y_len; y++) {
-                curr_grid[z][y].resize(x_len);
-                next_grid[z][y].resize(x_len);
-                for (size_t x = 0; x < x_len; x++) {
-                    curr_grid[z][y][x] = 0;
-                    next_grid[z][y][x] = 0;
-                }
-            }
-        }
+        Allocate();
     }
 
-    ResourceGradient(const grid_t & g) {
+    BasicResourceGradient(const grid_t & g) : diffusion_coefficients(1, 0.0), num_fields(1), toroidal(false) {
         x_len = g[0][0].size();        
         y_len = g[0].size();
         z_len = g.size();        
 
-        curr_grid.resize(z_len);
-        next_grid.resize(z_len);
+        Allocate();
 
         for (size_t z = 0; z < z_len; z++) {
-            curr_grid[z].resize(y_len);
-            next_grid[z].resize(y_len);
             for (size_t y = 0; y < y_len; y++) {
-                curr_grid[z][y].resize(x_len);
-                next_grid[z][y].resize(x_len);
                 for (size_t x = 0; x < x_len; x++) {
-                    curr_grid[z][y][x] = g[z][y][x];
-                    next_grid[z][y][x] = 0;
+                    curr_grid[Index(x, y, z)] = g[z][y][x];
                 }
             }
         }
     }
 
+    /// Position of (x, y, z) within the flat grid buffers
+    size_t Index(size_t x, size_t y, size_t z) const {
+        return z * plane_stride + y * row_stride + x;
+    }
+
+    /// Position of (x, y, z) of field @param field
+    size_t FieldIndex(size_t field, size_t x, size_t y, size_t z) const {
+        return Index(x, y, z) + field * field_stride;
+    }
+
+    /// Position of the voxel with cell id @param cell_id (x + x_len * (y +
+    /// y_len * z), i.e. without padding). Planes are not padded, so row r
+    /// starts at r * row_stride whatever the number of dimensions.
+    size_t CellIndex(size_t cell_id) const {
+        const size_t r = cell_id / x_len;
+        return r * row_stride + (cell_id - r * x_len);
+    }
+
+    /// 2D grids (z_len == 1) use the 2D instantiations of the stencil kernels
+    bool IsFlat() const {return z_len == 1;}
+
+    size_t GetXLen() const {return x_len;}
+    size_t GetYLen() const {return y_len;}
+    size_t GetZLen() const {return z_len;}
+    size_t GetNumFields() const {return num_fields;}
+    size_t GetFieldStride() const {return field_stride;}
+    size_t GetRowStride() const {return row_stride;}
+    size_t GetPlaneStride() const {return plane_stride;}
+
+    T * GetCurrData() {return curr_grid.data();}
+    const T * GetCurrData() const {return curr_grid.data();}
+    T * GetNextData() {return next_grid.data();}
+    const T * GetNextData() const {return next_grid.data();}
+
     void SetVal(size_t x, size_t y, size_t z, double val) {
-        curr_grid[z][y][x] = val;
+        curr_grid[Index(x, y, z)] = val;
     }
 
     void SetNextVal(size_t x, size_t y, size_t z, double val) {
-        next_grid[z][y][x] = val;
+        next_grid[Index(x, y, z)] = val;
     }
 
     void IncVal(size_t x, size_t y, size_t z, double val) {
-        curr_grid[z][y][x] += val;
+        curr_grid[Index(x, y, z)] += val;
     }
 
     void IncNextVal(size_t x, size_t y, size_t z, double val) {
-        next_grid[z][y][x] += val;
+        next_grid[Index(x, y, z)] += val;
     }
 
     void DecVal(size_t x, size_t y, size_t z, double val) {
-        curr_grid[z][y][x] -= val;
-        if (curr_grid[z][y][x] < 0) {
-            curr_grid[z][y][x] = 0;
+        T & cell = curr_grid[Index(x, y, z)];
+        cell -= val;
+        if (cell < 0) {
+            cell = 0;
         }
     }
 
     void DecNextVal(size_t x, size_t y, size_t z, double val) {
-        next_grid[z][y][x] -= val;
-        if (next_grid[z][y][x] < 0) {
-            next_grid[z][y][x] = 0;
+        T & cell = next_grid[Index(x, y, z)];
+        cell -= val;
+        if (cell < 0) {
+            cell = 0;
+        }
+    }
+
+    /// Cell id versions of the accessors above, for loops over cells
+    double GetCellVal(size_t cell_id) const {
+        return curr_grid[CellIndex(cell_id)];
+    }
+
+    void IncNextCellVal(size_t cell_id, double val) {
+        next_grid[CellIndex(cell_id)] += val;
+    }
+
+    void DecNextCellVal(size_t cell_id, double val) {
+        T & cell = next_grid[CellIndex(cell_id)];
+        cell -= val;
+        if (cell < 0) {
+            cell = 0;
         }
     }
 
     double GetVal(size_t x, size_t y, size_t z=0) const {
-        return curr_grid[z][y][x];
+        return curr_grid[Index(x, y, z)];
     } 
 
+    /// Accessors for any of the fields
+    double GetFieldVal(size_t field, size_t x, size_t y, size_t z=0) const {
+        return curr_grid[FieldIndex(field, x, y, z)];
+    }
+
+    void SetFieldVal(size_t field, size_t x, size_t y, size_t z, double val) {
+        curr_grid[FieldIndex(field, x, y, z)] = val;
+    }
+
+    double GetCellFieldVal(size_t field, size_t cell_id) const {
+        return curr_grid[CellIndex(cell_id) + field * field_stride];
+    }
+
     double GetNextVal(size_t x, size_t y, size_t z = 0) const {
-        return next_grid[z][y][x];
+        return next_grid[Index(x, y, z)];
     } 
 
     void SetDiffusionCoefficient(double coef) {
-        diffusion_coefficient = coef;
+        diffusion_coefficients[0] = coef;
     }
 
     double GetDiffusionCoefficient() {
-        return diffusion_coefficient;
+        return diffusion_coefficients[0];
+    }
+
+    void SetFieldDiffusionCoefficient(size_t field, double coef) {
+        diffusion_coefficients[field] = coef;
+    }
+
+    double GetFieldDiffusionCoefficient(size_t field) const {
+        return diffusion_coefficients[field];
     }
 
     void SetToroidal(bool tor) {
         toroidal = tor;
     }
 
+    bool GetToroidal() const {
+        return toroidal;
+    }
+
+    /// Use compensated summation in the explicit stencil (see
+    /// stencil::StepCompensated): slower, but float fields drift less
+    void SetCompensated(bool comp) {
+        compensated = comp;
+    }
+
+    bool GetCompensated() const {
+        return compensated;
+    }
+
+    /// Number of (y, z) rows; range-based methods below take row indices
+    /// in [0, GetNumRows()), with row r = (r % y_len, r / y_len).
+    size_t GetNumRows() const {
+        return y_len * z_len;
+    }
+
     void Update() {
-        std::swap(curr_grid, next_grid);
-        for (size_t z = 0; z < z_len; z++) {
-            for (size_t y = 0; y < y_len; y++) {
-                for (size_t x = 0; x < x_len; x++) {
-                    // zero out new next grid
-                    next_grid[z][y][x] = 0;
+        SwapGrids();
+        ResetRows(0, GetNumRows());
+    }
 
-                    // Make sure there are no negative numbers in the
-                    // new curr_grid
-                    if (curr_grid[z][y][x] < 0) {
-                        curr_grid[z][y][x] = 0;
-                    }
+    /// First half of Update(): exchange curr and next without touching data
+    void SwapGrids() {
+        curr_grid.Swap(next_grid);
+    }
+
+    /// Second half of Update() for rows [row_begin, row_end)
+    void ResetRows(size_t row_begin, size_t row_end) {
+        T * curr = curr_grid.data();
+        T * next = next_grid.data();
+        for (size_t r = row_begin; r < row_end; r++) {
+            const size_t offset = (r / y_len) * plane_stride + (r % y_len) * row_stride;
+            for (size_t i = offset; i < offset + x_len; i++) {
+                // zero out new next grid
+                next[i] = 0;
+
+                // Make sure there are no negative numbers in the
+                // new curr_grid
+                if (curr[i] < 0) {
+                    curr[i] = 0;
                 }
             }
-        }        
+        }
     }
 
     double GetNeighborOxygen(size_t x, size_t y, size_t z) {
@@ -132,52 +308,52 @@ class ResourceGradient {
             // Handle left
             if (x <= 0) {
                 // Wrap around if toroidal and on left edge
-                total += curr_grid[z][y][x_len-1];
+                total += curr_grid[Index(x_len-1, y, z)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z][y][x-1];
+                total += curr_grid[Index(x-1, y, z)];
             }
 
             // Handle right
             if (x + 1 >= x_len) {
                 // Wrap around if toroidal and on right edge
-                total += curr_grid[z][y][0];
+                total += curr_grid[Index(0, y, z)];
             } else {
-                total += curr_grid[z][y][x+1];
+                total += curr_grid[Index(x+1, y, z)];
             }
 
             // Handle top
             if (y <= 0) {
                 // Wrap around if toroidal and on top edge
-                total += curr_grid[z][y_len-1][x];
+                total += curr_grid[Index(x, y_len-1, z)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z][y-1][x];
+                total += curr_grid[Index(x, y-1, z)];
             }
 
             // Handle bottom
             if (y + 1 >= y_len) {
                 // Wrap around if toroidal and on bottom edge
-                total += curr_grid[z][0][x];
+                total += curr_grid[Index(x, 0, z)];
             } else {
-                total += curr_grid[z][y+1][x];
+                total += curr_grid[Index(x, y+1, z)];
             }
 
             // Handle below
             if (z <= 0) {
                 // Wrap around if toroidal and on top edge
-                total += curr_grid[z_len - 1][y][x];
+                total += curr_grid[Index(x, y, z_len - 1)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z-1][y][x];
+                total += curr_grid[Index(x, y, z-1)];
             }
 
             // Handle above
             if (z + 1 >= z_len) {
                 // Wrap around if toroidal and on bottom edge
-                total += curr_grid[0][y][x];
+                total += curr_grid[Index(x, y, 0)];
             } else {
-                total += curr_grid[z+1][y][x];
+                total += curr_grid[Index(x, y, z+1)];
             }
 
 
@@ -187,70 +363,484 @@ class ResourceGradient {
             // Handle left
             if (x <= 0) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z][y][x-1];
+                total += curr_grid[Index(x-1, y, z)];
             }
 
             // Handle right
             if (x + 1 >= x_len) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
-                total += curr_grid[z][y][x+1];
+                total += curr_grid[Index(x+1, y, z)];
             }
 
             // Handle top
             if (y <= 0) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z][y-1][x];
+                total += curr_grid[Index(x, y-1, z)];
             }
 
             // Handle bottom
             if (y + 1 >= y_len) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
-                total += curr_grid[z][y+1][x];
+                total += curr_grid[Index(x, y+1, z)];
             }
 
             // Handle below
             if (z <= 0) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
                 // Otherwise no adjustment is needed
-                total += curr_grid[z-1][y][x];
+                total += curr_grid[Index(x, y, z-1)];
             }
 
             // Handle above
             if (z + 1 >= z_len) {
                 // Do the Drichelet thing
-                total += curr_grid[z][y][x];
+                total += curr_grid[Index(x, y, z)];
             } else {
-                total += curr_grid[z+1][y][x];
+                total += curr_grid[Index(x, y, z+1)];
             }
         }
 
         return total;
     }
 
+    StencilGrid<T> GetStencilGrid() {
+        return StencilGrid<T>{curr_grid.data(), next_grid.data(), x_len, y_len, z_len,
+                           row_stride, plane_stride, toroidal};
+    }
+
     void Diffuse() {
+        Diffuse(0, GetNumRows());
+    }
+
+    /// Diffuse rows [row_begin, row_end) only; disjoint ranges can safely
+    /// be processed concurrently.
+    void Diffuse(size_t row_begin, size_t row_end) {
+        WithKernel([&](auto dims, auto comp){
+            stencil::Diffuse<decltype(dims)::value, decltype(comp)::value>(
+                GetStencilGrid(), diffusion_coefficients[0], row_begin, row_end);
+        });
+    }
+
+    /// Make sure the extra buffer that FusedUpdate() writes into exists.
+    /// Must be called (from a single thread) before FusedUpdate().
+    void PrepareFusedUpdate() {
+        if (scratch_grid.size() != curr_grid.size()) {
+            scratch_grid.Resize(curr_grid.size());
+        }
+    }
+
+    /// One complete public good step (see stencil::FusedUpdate) for rows
+    /// [row_begin, row_end). Equivalent to consuming/producing into the next
+    /// grid, Diffuse(), Update() and applying production and decay again,
+    /// but streams through memory once. Disjoint row ranges can run
+    /// concurrently; call FinishFusedUpdate() once all rows are done.
+    void FusedUpdate(const stencil::SourceTerms & src, size_t row_begin, size_t row_end) {
+        WithKernel([&](auto dims, auto comp){
+            stencil::FusedUpdate<decltype(dims)::value, decltype(comp)::value>(
+                GetStencilGrid(), scratch_grid.data(), src, diffusion_coefficients[0], row_begin, row_end);
+        });
+    }
+
+    /// FusedUpdate() of every field at once (see stencil::FusedUpdateFields),
+    /// field f with sources @param src[f] (an array of GetNumFields()). The
+    /// masks are taken from src[0]. Used like FusedUpdate(), between
+    /// PrepareFusedUpdate() and FinishFusedUpdate().
+    void FusedUpdateFields(const stencil::SourceTerms * src, size_t row_begin, size_t row_end) {
+        WithKernel([&](auto dims, auto comp){
+            stencil::FusedUpdateFields<decltype(dims)::value, decltype(comp)::value>(
+                GetStencilGrid(), scratch_grid.data(), src, diffusion_coefficients.data(),
+                num_fields, field_stride, row_begin, row_end);
+        });
+    }
+
+    /// @param steps FusedUpdate() steps in a row for rows [row_begin,
+    /// row_end), computed as a cache-resident wavefront (see
+    /// stencil::BlockedUpdate). Needs PrepareFusedUpdate() beforehand, and
+    /// ResetSources() over all rows followed by FinishFusedUpdate() after
+    /// all ranges are done. Only valid for non-toroidal grids.
+    void BlockedUpdate(const stencil::SourceTerms & src, size_t steps, size_t row_begin, size_t row_end) {
+        WithKernel([&](auto dims, auto comp){
+            stencil::BlockedUpdate<decltype(dims)::value, decltype(comp)::value>(
+                GetStencilGrid(), scratch_grid.data(), src, diffusion_coefficients[0], steps, row_begin, row_end);
+        });
+    }
+
+    void ResetSources(const stencil::SourceTerms & src, size_t row_begin, size_t row_end) {
+        if (IsFlat()) stencil::ResetSources<2>(GetStencilGrid(), src, row_begin, row_end);
+        else stencil::ResetSources<3>(GetStencilGrid(), src, row_begin, row_end);
+    }
+
+    /// Prepare the axis solvers for implicit steps that each cover @param
+    /// steps explicit steps' worth of diffusion.
+    void SetupImplicit(size_t steps) {
+        const double k = diffusion_coefficients[0] * steps;
+        x_solver.Setup(x_len, k, toroidal);
+        y_solver.Setup(y_len, k, toroidal);
+        z_solver.Setup(z_len, k, toroidal);
+    }
+
+    /// First stage of an implicit step covering @param steps explicit
+    /// steps, for rows [row_begin, row_end): turn curr into the right-hand
+    /// side by adding everything the sources would have contributed over
+    /// those steps, and leave the new pending sources in next. The pending
+    /// sources count once; production/decay count for the remaining steps.
+    /// Consumption is evaluated against the field at the start of the step.
+    void AddImplicitSources(const stencil::SourceTerms & src, size_t steps,
+                            size_t row_begin, size_t row_end) {
+        double new_source[2];
+        stencil::NewSources(src, new_source);
+        for (size_t r = row_begin; r < row_end; r++) {
+            const size_t offset = (r / y_len) * plane_stride + (r % y_len) * row_stride;
+            T * c = curr_grid.data() + offset;
+            T * s = next_grid.data() + offset;
+            const unsigned char * occupied = src.occupied + r * x_len;
+            const unsigned char * producer = src.producer + r * x_len;
+
+            stencil::ConsumeRow(c, s, occupied, src, x_len);
+            for (size_t x = 0; x < x_len; x++) {
+                double later = new_source[producer[x] != 0];
+                if (occupied[x]) {
+                    double loss_multiplier = c[x];
+                    loss_multiplier /= loss_multiplier + src.km;
+                    later -= src.consumption * loss_multiplier;
+                    if (later < 0) later = 0;
+                }
+                c[x] += s[x] + (double)(steps - 1) * later;
+                s[x] = new_source[producer[x] != 0];
+            }
+        }
+    }
+
+    /// Implicit solve along x for rows [row_begin, row_end)
+    void SolveImplicitX(size_t row_begin, size_t row_end) {
+        for (size_t r = row_begin; r < row_end; r++) {
+            x_solver.Solve(curr_grid.data() + (r / y_len) * plane_stride + (r % y_len) * row_stride, 1, 1, 1);
+        }
+    }
+
+    /// Implicit solve along y for planes [z_begin, z_end)
+    void SolveImplicitY(size_t z_begin, size_t z_end) {
+        for (size_t z = z_begin; z < z_end; z++) {
+            y_solver.Solve(curr_grid.data() + z * plane_stride, row_stride, x_len, 1);
+        }
+    }
+
+    /// Implicit solve along z for the columns in y rows [y_begin, y_end)
+    void SolveImplicitZ(size_t y_begin, size_t y_end) {
+        for (size_t y = y_begin; y < y_end; y++) {
+            z_solver.Solve(curr_grid.data() + y * row_stride, plane_stride, x_len, 1);
+        }
+    }
+
+    /// Start keeping track of which rows are all zero, so that
+    /// FusedUpdateActive() can skip them. Rows whose field drops below
+    /// @param epsilon everywhere (and that have no producers) are set to
+    /// zero and stop being updated; with epsilon 0 only rows that are
+    /// exactly zero are skipped, and results match FusedUpdate() exactly.
+    /// Zeroing takes less than epsilon from a voxel at a time, but the
+    /// losses add up: against a full update (200x200x100 grid seeded with
+    /// 5 cells, 30 updates, epsilon 1e-12), the largest difference in any
+    /// voxel was 7.6e-12.
+    ///
+    /// The tracking only records which rows are zero, so it is rebuilt
+    /// from the grids alone: call again after writing to them directly
+    /// (e.g. through SetVal() or when loading a checkpoint), which does
+    /// not change the results.
+    void TrackActiveRows(double epsilon) {
+        active_epsilon = epsilon;
+        const size_t num_rows = GetNumRows();
+        curr_live.resize(num_rows);
+        scratch_live.resize(num_rows);
+        source_live.resize(num_rows);
+        for (size_t r = 0; r < num_rows; r++) {
+            curr_live[r] = !RowIsZero(curr_grid, r);
+            scratch_live[r] = !RowIsZero(scratch_grid, r);
+            source_live[r] = !RowIsZero(next_grid, r);
+        }
+    }
+
+    bool IsTrackingActiveRows() const {return curr_live.size() == GetNumRows();}
+
+    /// Row @param r can change in the next step: it has pending sources or
+    /// it or one of its four stencil neighbor rows holds some field.
+    bool IsRowActive(size_t r) const {
+        if (source_live[r] || curr_live[r]) return true;
+        const size_t y = r % y_len;
+        const size_t z = r / y_len;
+        if (y > 0) {
+            if (curr_live[r - 1]) return true;
+        } else if (toroidal && curr_live[r + y_len - 1]) return true;
+        if (y + 1 < y_len) {
+            if (curr_live[r + 1]) return true;
+        } else if (toroidal && curr_live[r + 1 - y_len]) return true;
+        if (z > 0) {
+            if (curr_live[r - y_len]) return true;
+        } else if (toroidal && curr_live[r + (z_len - 1) * y_len]) return true;
+        if (z + 1 < z_len) {
+            if (curr_live[r + y_len]) return true;
+        } else if (toroidal && curr_live[r - z * y_len]) return true;
+        return false;
+    }
+
+    /// Number of rows FusedUpdateActive() would update next
+    size_t CountActiveRows() const {
+        if (!IsTrackingActiveRows()) return GetNumRows();
+        size_t count = 0;
+        for (size_t r = 0; r < GetNumRows(); r++) {
+            count += IsRowActive(r);
+        }
+        return count;
+    }
+
+    /// FusedUpdate() for the rows in [row_begin, row_end) that can change,
+    /// as tracked since TrackActiveRows(). @param producer_rows flags the
+    /// rows that hold a producer, which always need their sources laid down.
+    /// Inactive rows are all zero in every grid, and so stay that way.
+    void FusedUpdateActive(const stencil::SourceTerms & src, const unsigned char * producer_rows,
+                           size_t row_begin, size_t row_end) {
+        double new_source[2];
+        stencil::NewSources(src, new_source);
+        // Sources that appear without any producer make every row active
+        const bool all_active = new_source[0] != 0;
+
+        const StencilGrid<T> g = GetStencilGrid();
+        for (size_t r = row_begin; r < row_end; r++) {
+            T * o = scratch_grid.data() + (r / y_len) * plane_stride + (r % y_len) * row_stride;
+            if (!all_active && !producer_rows[r] && !IsRowActive(r)) {
+                // Everything around this row is zero, so the new row is too
+                if (scratch_live[r]) {
+                    std::fill(o, o + x_len, T(0));
+                    scratch_live[r] = 0;
+                }
+                continue;
+            }
+
+            WithKernel([&](auto dims, auto comp){
+                stencil::FusedUpdate<decltype(dims)::value, decltype(comp)::value>(
+                    g, scratch_grid.data(), src, diffusion_coefficients[0], r, r + 1);
+            });
+
+            double row_max = 0;
+            for (size_t x = 0; x < x_len; x++) {
+                row_max = std::max(row_max, (double)o[x]);
+            }
+            if (row_max > 0 && row_max < active_epsilon) {
+                std::fill(o, o + x_len, T(0));
+                row_max = 0;
+            }
+            scratch_live[r] = row_max > 0;
+            source_live[r] = all_active || (producer_rows[r] && new_source[1] != 0);
+        }
+    }
+
+    /// Start tracking which rows have settled, for FusedUpdateSteady(). A
+    /// row settles once no field in it or its four stencil neighbor rows
+    /// changes by more than @param epsilon in a step; it is then frozen
+    /// until that stops being true or a cell in it is born or dies. With
+    /// epsilon 0 only rows that did not change at all freeze, and results
+    /// match FusedUpdate() exactly. Call again after writing to the grids
+    /// directly (e.g. through SetVal()): every row starts out awake.
+    void TrackSteadyRows(double epsilon) {
+        steady_epsilon = epsilon;
+        const size_t num_rows = GetNumRows();
+        curr_moved.assign(num_rows, 1);
+        scratch_moved.assign(num_rows, 1);
+        curr_frozen.assign(num_rows, 0);
+        scratch_frozen.assign(num_rows, 0);
+        steady_hold.assign(num_rows, 2);
+        steady_occupied.assign(num_rows * x_len, 0);
+        steady_producer.assign(num_rows * x_len, 0);
+    }
+
+    bool IsTrackingSteadyRows() const {return curr_moved.size() == GetNumRows();}
+
+    /// Copy the state tracked since TrackSteadyRows() into @param rows, one
+    /// byte per row (moved, frozen << 1 and hold << 2), and @param cells,
+    /// one byte per voxel in cell id order (occupied and producer << 1 as
+    /// the row was last updated with), e.g. for a checkpoint.
+    void SaveSteadyRows(std::vector<unsigned char> & rows, std::vector<unsigned char> & cells) const {
+        rows.resize(GetNumRows());
+        cells.resize(steady_occupied.size());
+        for (size_t r = 0; r < rows.size(); r++) {
+            rows[r] = (unsigned char)(curr_moved[r] | curr_frozen[r] << 1 | steady_hold[r] << 2);
+        }
+        for (size_t i = 0; i < cells.size(); i++) {
+            cells[i] = (unsigned char)(steady_occupied[i] | steady_producer[i] << 1);
+        }
+    }
+
+    /// Carry on tracking settled rows from the state saved by
+    /// SaveSteadyRows() in @param rows and @param cells, with the current
+    /// grids restored from the same point of the run, so that the same
+    /// rows freeze as in the run that was saved. @return false (and track
+    /// nothing) if the state is for another grid size.
+    bool LoadSteadyRows(double epsilon, const std::vector<unsigned char> & rows,
+                        const std::vector<unsigned char> & cells) {
+        if (rows.size() != GetNumRows() || cells.size() != GetNumRows() * x_len) return false;
+        TrackSteadyRows(epsilon);
+        PrepareFusedUpdate();
+        for (size_t r = 0; r < rows.size(); r++) {
+            curr_moved[r] = rows[r] & 1;
+            curr_frozen[r] = (rows[r] >> 1) & 1;
+            steady_hold[r] = (unsigned char)(rows[r] >> 2);
+            if (!curr_frozen[r]) continue;
+            // Frozen rows are not copied into scratch_grid again
+            const size_t offset = (r / y_len) * plane_stride + (r % y_len) * row_stride;
+            for (size_t f = 0; f < num_fields; f++) {
+                std::copy(curr_grid.data() + offset + f * field_stride,
+                          curr_grid.data() + offset + f * field_stride + x_len,
+                          scratch_grid.data() + offset + f * field_stride);
+            }
+        }
+        for (size_t i = 0; i < cells.size(); i++) {
+            steady_occupied[i] = cells[i] & 1;
+            steady_producer[i] = (cells[i] >> 1) & 1;
+        }
+        return true;
+    }
+
+    /// Row @param r and its four stencil neighbor rows all changed by at
+    /// most the tracking epsilon in the last step (or were frozen), so row
+    /// r will not change in the next one
+    bool IsRowSettled(size_t r) const {
+        auto quiet = [this](size_t row){
+            return curr_frozen[row] || !curr_moved[row];
+        };
+        if (!quiet(r)) return false;
+        const size_t y = r % y_len;
+        const size_t z = r / y_len;
+        if (y > 0) {
+            if (!quiet(r - 1)) return false;
+        } else if (toroidal && !quiet(r + y_len - 1)) return false;
+        if (y + 1 < y_len) {
+            if (!quiet(r + 1)) return false;
+        } else if (toroidal && !quiet(r + 1 - y_len)) return false;
+        if (z > 0) {
+            if (!quiet(r - y_len)) return false;
+        } else if (toroidal && !quiet(r + (z_len - 1) * y_len)) return false;
+        if (z + 1 < z_len) {
+            if (!quiet(r + y_len)) return false;
+        } else if (toroidal && !quiet(r - z * y_len)) return false;
+        return true;
+    }
+
+    /// Number of rows frozen by the last FusedUpdateSteady()
+    size_t CountFrozenRows() const {
+        if (!IsTrackingSteadyRows()) return 0;
+        size_t count = 0;
+        for (unsigned char frozen : curr_frozen) count += frozen;
+        return count;
+    }
+
+    /// FusedUpdateFields() for the rows in [row_begin, row_end) that have
+    /// not settled, as tracked since TrackSteadyRows(). Settled rows are
+    /// frozen: copied once into the new grid, then skipped. A frozen row
+    /// wakes up as soon as a row next to it changes by more than epsilon,
+    /// or when the occupied or producer mask of its own cells changes; it
+    /// then carries on from its frozen values, so a birth or death only
+    /// costs updates in the rows that it actually disturbs. Such a row is
+    /// updated for at least two steps, the second one for the sources its
+    /// new cells leave behind.
+    void FusedUpdateSteady(const stencil::SourceTerms * src, size_t row_begin, size_t row_end) {
+        const StencilGrid<T> g = GetStencilGrid();
+        const T epsilon = (T)steady_epsilon;
+
+        auto update_chunk = [&](size_t chunk_begin, size_t chunk_end){
+            WithKernel([&](auto dims, auto comp){
+                stencil::FusedUpdateFields<decltype(dims)::value, decltype(comp)::value>(
+                    g, scratch_grid.data(), src, diffusion_coefficients.data(),
+                    num_fields, field_stride, chunk_begin, chunk_end);
+            });
+            for (size_t r = chunk_begin; r < chunk_end; r++) {
+                const size_t offset = (r / y_len) * plane_stride + (r % y_len) * row_stride;
+                const T * c = curr_grid.data() + offset;
+                const T * o = scratch_grid.data() + offset;
+                bool moved = false;
+                for (size_t f = 0; f < num_fields; f++) {
+                    for (size_t x = f * field_stride; x < f * field_stride + x_len; x++) {
+                        moved |= (o[x] > c[x] ? o[x] - c[x] : c[x] - o[x]) > epsilon;
+                    }
+                }
+                scratch_moved[r] = moved;
+                scratch_frozen[r] = 0;
+                if (steady_hold[r]) steady_hold[r]--;
+            }
+        };
+
+        // Update rows [run_begin, run_end) and note which of them moved, a
+        // few rows at a time so that they are still in cache for the latter
+        auto update_run = [&](size_t run_begin, size_t run_end){
+            for (size_t chunk = run_begin; chunk < run_end; chunk += STEADY_CHUNK_ROWS) {
+                update_chunk(chunk, std::min(run_end, chunk + STEADY_CHUNK_ROWS));
+            }
+        };
+
+        size_t run_begin = row_begin;
+        for (size_t r = row_begin; r < row_end; r++) {
+            const unsigned char * occupied = src[0].occupied + r * x_len;
+            const unsigned char * producer = src[0].producer + r * x_len;
+            unsigned char * last_occupied = steady_occupied.data() + r * x_len;
+            unsigned char * last_producer = steady_producer.data() + r * x_len;
+            if (!std::equal(occupied, occupied + x_len, last_occupied)
+                || !std::equal(producer, producer + x_len, last_producer)) {
+                std::copy(occupied, occupied + x_len, last_occupied);
+                std::copy(producer, producer + x_len, last_producer);
+                steady_hold[r] = 2;
+            }
+            if (steady_hold[r] || !IsRowSettled(r)) continue;
+
+            update_run(run_begin, r);
+            run_begin = r + 1;
+            if (!curr_frozen[r]) {
+                const size_t offset = (r / y_len) * plane_stride + (r % y_len) * row_stride;
+                const T * c = curr_grid.data() + offset;
+                T * o = scratch_grid.data() + offset;
+                for (size_t f = 0; f < num_fields; f++) {
+                    std::copy(c + f * field_stride, c + f * field_stride + x_len, o + f * field_stride);
+                }
+            }
+            scratch_frozen[r] = 1;
+            scratch_moved[r] = 0;
+        }
+        update_run(run_begin, row_end);
+    }
+
+    /// Make the field computed by FusedUpdate() the current one
+    void FinishFusedUpdate() {
+        curr_grid.Swap(scratch_grid);
+        curr_live.swap(scratch_live);
+        curr_moved.swap(scratch_moved);
+        curr_frozen.swap(scratch_frozen);
+    }
+
+    /// Straightforward voxel-by-voxel version of Diffuse(), kept as the
+    /// reference the vectorized kernel is checked against.
+    void DiffuseReference() {
         for (size_t z = 0; z < z_len; z++) {
             for (size_t x = 0; x < x_len; x++) {
                 for (size_t y = 0; y < y_len; y++) {
-                    next_grid[z][y][x] += curr_grid[z][y][x] + 
-                            (diffusion_coefficient * 
+                    next_grid[Index(x, y, z)] += curr_grid[Index(x, y, z)] + 
+                            (diffusion_coefficients[0] * 
                             (GetNeighborOxygen(x, y, z) - 
-                            (6.0 * curr_grid[z][y][x]))); // 6.0 is from central difference approximation
+                            (6.0 * curr_grid[Index(x, y, z)]))); // 6.0 is from central difference approximation
                 }
             }
         }
     }
 };
 
+using ResourceGradient = BasicResourceGradient<double>;
+
 #endif
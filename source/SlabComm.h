@@ -0,0 +1,113 @@
+#ifndef _SlabComm_H
+#define _SlabComm_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#ifdef HCA_MPI
+#include <mpi.h>
+#endif
+
+/// The processes of a distributed run (see HCASlabWorld): MPI_COMM_WORLD
+/// in builds with HCA_MPI (make USE_MPI=1), otherwise just this process.
+/// Construct one at the start of main() and keep it until the end; it
+/// initializes and finalizes MPI.
+///
+/// Only the few collectives the slab engine needs are wrapped, all on raw
+/// bytes or doubles. Exchanges are a z-plane at a time, well inside the
+/// int counts MPI takes; Gather() is limited to 2 GB in all.
+class SlabComm {
+    int rank = 0;
+    int size = 1;
+
+    public:
+    static constexpr int NONE = -1; // No neighbor on this side
+
+    SlabComm(int & argc, char ** & argv) {
+#ifdef HCA_MPI
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+#else
+        (void)argc;
+        (void)argv;
+#endif
+    }
+
+    SlabComm(const SlabComm &) = delete;
+    SlabComm & operator=(const SlabComm &) = delete;
+
+    ~SlabComm() {
+#ifdef HCA_MPI
+        MPI_Finalize();
+#endif
+    }
+
+    int GetRank() const {return rank;}
+    int GetSize() const {return size;}
+    bool IsRoot() const {return rank == 0;}
+
+    /// Send @param send_bytes bytes to @param dest while receiving
+    /// @param recv_bytes from @param source; either may be NONE
+    void SendRecv(int dest, const void * send, size_t send_bytes, int source, void * recv, size_t recv_bytes) {
+#ifdef HCA_MPI
+        MPI_Sendrecv(send, (int)send_bytes, MPI_BYTE, dest == NONE ? MPI_PROC_NULL : dest, 0,
+                     recv, (int)recv_bytes, MPI_BYTE, source == NONE ? MPI_PROC_NULL : source, 0,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#else
+        // A single process has no neighbors
+        (void)dest; (void)send; (void)send_bytes; (void)source; (void)recv; (void)recv_bytes;
+#endif
+    }
+
+    /// Copy the root's @param bytes bytes at @param data to every process
+    void Broadcast(void * data, size_t bytes) {
+#ifdef HCA_MPI
+        MPI_Bcast(data, (int)bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+#else
+        (void)data;
+        (void)bytes;
+#endif
+    }
+
+    /// Replace @param vals[0, n) on every process by their sum over all
+    /// processes
+    void SumAll(double * vals, size_t n) {
+#ifdef HCA_MPI
+        MPI_Allreduce(MPI_IN_PLACE, vals, (int)n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#else
+        (void)vals;
+        (void)n;
+#endif
+    }
+
+    /// Concatenate every process's @param send, in rank order, into
+    /// @param recv on the root (other processes' recv is left empty)
+    void Gather(const std::vector<char> & send, std::vector<char> & recv) {
+#ifdef HCA_MPI
+        int bytes = (int)send.size();
+        std::vector<int> counts(IsRoot() ? size : 0), offsets(IsRoot() ? size : 0);
+        MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        size_t total = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            offsets[i] = (int)total;
+            total += (size_t)counts[i];
+        }
+        recv.assign(total, 0);
+        MPI_Gatherv(send.data(), bytes, MPI_BYTE, recv.data(), counts.data(), offsets.data(), MPI_BYTE,
+                    0, MPI_COMM_WORLD);
+#else
+        recv = send;
+#endif
+    }
+
+    /// Whether @param ok holds on every process
+    bool All(bool ok) {
+        double failed = ok ? 0 : 1;
+        SumAll(&failed, 1);
+        return failed == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,531 @@
+#ifndef _Snapshot_H
+#define _Snapshot_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef HCA_ZSTD
+#include <zstd.h>
+#endif
+
+#include "Checkpoint.h"
+
+/// Time series of per-voxel volumes (public good and cell traits) in one
+/// file. Layout, all in native byte order:
+///
+///   file header:  "HCASNAP" magic, version, field count, x/y/z lengths,
+///                 planes per chunk, then a name and type for each field
+///   frame (repeated, one per snapshot):
+///                 "FRME", update, total frame size, then one index entry
+///                 (offset, stored size, raw size, codec) per field and
+///                 chunk, then the chunk data
+///
+/// Every field is split into chunks of planes_per_chunk z-planes, each
+/// stored raw or zstd-compressed. The frame size lets a reader hop from
+/// frame to frame reading only headers, and the index lets it decompress
+/// just the chunk holding a given plane.
+namespace snapshot {
+
+    enum Type : uint32_t {U8 = 0, I32 = 1, F64 = 2};
+    enum Codec : uint32_t {RAW = 0, ZSTD = 1};
+
+    constexpr char FILE_MAGIC[8] = {'H', 'C', 'A', 'S', 'N', 'A', 'P', '\0'};
+    constexpr char FRAME_MAGIC[4] = {'F', 'R', 'M', 'E'};
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t NAME_LEN = 32;
+
+    inline size_t TypeSize(uint32_t type) {
+        switch (type) {
+            case U8: return 1;
+            case I32: return 4;
+            case F64: return 8;
+        }
+        return 0;
+    }
+
+    struct FieldInfo {
+        std::string name;
+        uint32_t type;
+    };
+
+    struct ChunkEntry {
+        uint64_t offset;      // From the start of the frame
+        uint64_t stored_size;
+        uint64_t raw_size;
+        uint32_t codec;
+        uint32_t unused;
+    };
+
+    constexpr size_t NUM_CELL_FIELDS = 5; // Fields before the extra ones
+
+    /// Fields written by SnapshotWriter, taken from a Checkpoint: the
+    /// public good and cell traits, then one per extra field, named
+    /// @param extra_field_names
+    inline std::vector<FieldInfo> CheckpointFields(const std::vector<std::string> & extra_field_names = {}) {
+        std::vector<FieldInfo> fields = {{"public_good", F64}, {"occupied", U8}, {"producer", U8},
+                                         {"age", I32}, {"resistance", F64}};
+        for (const std::string & name : extra_field_names) {
+            fields.push_back({name, F64});
+        }
+        return fields;
+    }
+
+    inline const unsigned char * CheckpointField(const Checkpoint & cp, size_t field) {
+        switch (field) {
+            case 0: return reinterpret_cast<const unsigned char *>(cp.curr_field.data());
+            case 1: return cp.occupied.data();
+            case 2: return cp.producer.data();
+            case 3: return reinterpret_cast<const unsigned char *>(cp.age.data());
+            case 4: return reinterpret_cast<const unsigned char *>(cp.resistance.data());
+        }
+        if (field - NUM_CELL_FIELDS < cp.extra_fields) {
+            return reinterpret_cast<const unsigned char *>(cp.extra_curr_field.data()
+                                                           + (field - NUM_CELL_FIELDS) * cp.GetSize());
+        }
+        return nullptr;
+    }
+
+    /// fseek()/ftell() with 64-bit offsets. Their long offsets are 32 bits
+    /// on Windows, which would cut off reading snapshots past 2 GB. On 32-bit
+    /// POSIX systems off_t is only 64 bits with _FILE_OFFSET_BITS=64.
+    inline bool SeekTo(FILE * file, uint64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    /// Current offset in @param file, or -1 on error
+    inline int64_t Tell(FILE * file) {
+#ifdef _WIN32
+        return (int64_t)_ftelli64(file);
+#else
+        return (int64_t)ftello(file);
+#endif
+    }
+
+    /// Reads individual planes or whole volumes out of a snapshot file
+    class SnapshotReader {
+        FILE * file = nullptr;
+        std::vector<FieldInfo> fields;
+        uint64_t x_len = 0, y_len = 0, z_len = 0, planes_per_chunk = 1;
+        uint64_t data_start = 0;        // Offset of the first frame
+        std::vector<uint64_t> frame_offsets;
+        std::vector<uint64_t> frame_sizes;
+        std::vector<uint64_t> frame_updates;
+        uint64_t end_of_frames = 0;     // Offset just past the last complete frame
+
+        bool ReadAt(uint64_t offset, void * dest, size_t bytes) const {
+            return SeekTo(file, offset) && std::fread(dest, 1, bytes, file) == bytes;
+        }
+
+        size_t NumChunks() const {return (size_t)((z_len + planes_per_chunk - 1) / planes_per_chunk);}
+
+        bool ReadEntry(size_t frame, size_t field, size_t chunk, ChunkEntry & entry) const {
+            const uint64_t pos = frame_offsets[frame] + 24 + (field * NumChunks() + chunk) * sizeof(ChunkEntry);
+            return ReadAt(pos, &entry, sizeof(entry));
+        }
+
+        /// Bytes chunk @param chunk of @param field holds once decompressed
+        size_t ChunkBytes(size_t field, size_t chunk) const {
+            const uint64_t z_begin = chunk * planes_per_chunk;
+            const uint64_t planes = std::min(planes_per_chunk, z_len - z_begin);
+            return (size_t)(planes * x_len * y_len) * TypeSize(fields[field].type);
+        }
+
+        /// Read and decompress a chunk into @param out. Entries that do not
+        /// fit the frame or the chunk's planes (a damaged file) are
+        /// rejected, so @param out always holds exactly ChunkBytes().
+        bool ReadChunk(size_t frame, size_t field, size_t chunk, std::vector<unsigned char> & out) const {
+            ChunkEntry entry;
+            if (!ReadEntry(frame, field, chunk, entry)) return false;
+            const size_t expected = ChunkBytes(field, chunk);
+            if (entry.raw_size != expected || entry.offset > frame_sizes[frame]
+                || entry.stored_size > frame_sizes[frame] - entry.offset
+                || (entry.codec == RAW && entry.stored_size != expected)) {
+                std::cerr << "Error: snapshot chunk " << chunk << " of field " << field << " in frame "
+                          << frame << " is damaged" << std::endl;
+                return false;
+            }
+            std::vector<unsigned char> stored(entry.stored_size);
+            if (!ReadAt(frame_offsets[frame] + entry.offset, stored.data(), stored.size())) return false;
+            if (entry.codec == RAW) {
+                out.swap(stored);
+                return true;
+            }
+#ifdef HCA_ZSTD
+            if (entry.codec == ZSTD) {
+                out.resize(entry.raw_size);
+                const size_t got = ZSTD_decompress(out.data(), out.size(), stored.data(), stored.size());
+                return !ZSTD_isError(got) && got == entry.raw_size;
+            }
+#endif
+            std::cerr << "Error: snapshot chunk uses a codec this build cannot read" << std::endl;
+            return false;
+        }
+
+        public:
+        SnapshotReader() {;}
+        SnapshotReader(const SnapshotReader &) = delete;
+        SnapshotReader & operator=(const SnapshotReader &) = delete;
+        ~SnapshotReader() {Close();}
+
+        void Close() {
+            if (file) std::fclose(file);
+            file = nullptr;
+        }
+
+        /// Open @param filename and index its frames (reading only headers)
+        bool Open(const std::string & filename) {
+            Close();
+            file = std::fopen(filename.c_str(), "rb");
+            if (!file) return false;
+
+            char magic[8];
+            uint32_t version = 0, num_fields = 0;
+            if (!ReadAt(0, magic, 8) || std::memcmp(magic, FILE_MAGIC, 8) != 0) return false;
+            if (std::fread(&version, 4, 1, file) != 1 || version != VERSION) return false;
+            if (std::fread(&num_fields, 4, 1, file) != 1) return false;
+            uint64_t dims[4];
+            if (std::fread(dims, 8, 4, file) != 4) return false;
+            x_len = dims[0];
+            y_len = dims[1];
+            z_len = dims[2];
+            planes_per_chunk = dims[3] ? dims[3] : 1;
+
+            fields.clear();
+            for (uint32_t f = 0; f < num_fields; f++) {
+                char name[NAME_LEN];
+                uint32_t type = 0;
+                if (std::fread(name, 1, NAME_LEN, file) != NAME_LEN || std::fread(&type, 4, 1, file) != 1) return false;
+                fields.push_back({std::string(name, strnlen(name, NAME_LEN)), type});
+            }
+            const int64_t header_end = Tell(file);
+            if (header_end < 0) return false;
+            data_start = (uint64_t)header_end;
+
+            // A frame cut short by a crash is ignored
+            frame_offsets.clear();
+            frame_sizes.clear();
+            frame_updates.clear();
+            uint64_t pos = data_start;
+            while (true) {
+                char frame_magic[4];
+                uint32_t unused = 0;
+                uint64_t header[2]; // update, frame size
+                if (!ReadAt(pos, frame_magic, 4) || std::memcmp(frame_magic, FRAME_MAGIC, 4) != 0) break;
+                if (std::fread(&unused, 4, 1, file) != 1 || std::fread(header, 8, 2, file) != 2) break;
+                unsigned char last;
+                if (header[1] < 24 || !ReadAt(pos + header[1] - 1, &last, 1)) break;
+                frame_offsets.push_back(pos);
+                frame_sizes.push_back(header[1]);
+                frame_updates.push_back(header[0]);
+                pos += header[1];
+            }
+            end_of_frames = pos;
+            return true;
+        }
+
+        size_t GetXLen() const {return (size_t)x_len;}
+        size_t GetYLen() const {return (size_t)y_len;}
+        size_t GetZLen() const {return (size_t)z_len;}
+        size_t GetPlanesPerChunk() const {return (size_t)planes_per_chunk;}
+        const std::vector<FieldInfo> & GetFields() const {return fields;}
+        size_t GetNumFrames() const {return frame_offsets.size();}
+        size_t GetUpdate(size_t frame) const {return (size_t)frame_updates[frame];}
+        uint64_t GetFrameOffset(size_t frame) const {return frame_offsets[frame];}
+        uint64_t GetEndOfFrames() const {return end_of_frames;}
+
+        /// Index of the field called @param name, or -1
+        int GetFieldID(const std::string & name) const {
+            for (size_t f = 0; f < fields.size(); f++) {
+                if (fields[f].name == name) return (int)f;
+            }
+            return -1;
+        }
+
+        /// Index of the frame for @param update, or -1
+        int GetFrameID(size_t update) const {
+            for (size_t i = 0; i < frame_updates.size(); i++) {
+                if (frame_updates[i] == update) return (int)i;
+            }
+            return -1;
+        }
+
+        /// Plane @param z of @param field in @param frame, x fastest.
+        /// Only the chunk holding that plane is read.
+        template <typename T>
+        bool ReadSlice(size_t frame, size_t field, size_t z, std::vector<T> & out) const {
+            if (frame >= GetNumFrames() || field >= fields.size() || z >= z_len
+                || TypeSize(fields[field].type) != sizeof(T)) return false;
+            std::vector<unsigned char> chunk;
+            if (!ReadChunk(frame, field, (size_t)(z / planes_per_chunk), chunk)) return false;
+            const size_t plane_bytes = (size_t)(x_len * y_len) * sizeof(T);
+            const size_t offset = (size_t)(z % planes_per_chunk) * plane_bytes;
+            if (offset + plane_bytes > chunk.size()) return false;
+            out.resize((size_t)(x_len * y_len));
+            std::memcpy(out.data(), chunk.data() + offset, plane_bytes);
+            return true;
+        }
+
+        /// The whole volume of @param field in @param frame, x fastest
+        template <typename T>
+        bool ReadVolume(size_t frame, size_t field, std::vector<T> & out) const {
+            if (frame >= GetNumFrames() || field >= fields.size()
+                || TypeSize(fields[field].type) != sizeof(T)) return false;
+            out.resize((size_t)(x_len * y_len * z_len));
+            unsigned char * dest = reinterpret_cast<unsigned char *>(out.data());
+            size_t remaining = out.size() * sizeof(T);
+            std::vector<unsigned char> chunk;
+            for (size_t c = 0; c < NumChunks(); c++) {
+                if (!ReadChunk(frame, field, c, chunk) || chunk.size() > remaining) return false;
+                std::memcpy(dest, chunk.data(), chunk.size());
+                dest += chunk.size();
+                remaining -= chunk.size();
+            }
+            return remaining == 0;
+        }
+    };
+
+    /// Appends frames to a snapshot file. Frames are queued and compressed
+    /// and written on a background thread; Submit() only blocks when two
+    /// frames are already waiting. If a frame cannot be written (e.g. the
+    /// disk is full), a warning is printed, later frames are dropped and
+    /// Close() cuts the file back to the last complete frame.
+    class SnapshotWriter {
+        static constexpr size_t MAX_QUEUED = 2;
+
+        FILE * file = nullptr;
+        std::string filename;
+        std::vector<FieldInfo> fields;
+        size_t x_len = 0, y_len = 0, z_len = 0, planes_per_chunk = 1;
+        bool compress = false;
+        uint64_t good_end = 0;            // Offset just past the last complete frame
+        std::atomic<bool> failed{false};
+
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::pair<size_t, Checkpoint>> queue;
+        bool busy = false;
+        bool stopping = false;
+
+        static bool SameFields(const std::vector<FieldInfo> & a, const std::vector<FieldInfo> & b) {
+            if (a.size() != b.size()) return false;
+            for (size_t f = 0; f < a.size(); f++) {
+                // Names are stored cut to NAME_LEN - 1 characters
+                if (a[f].type != b[f].type || a[f].name != b[f].name.substr(0, NAME_LEN - 1)) return false;
+            }
+            return true;
+        }
+
+        bool WriteFrame(size_t update, const Checkpoint & cp) {
+            const size_t num_chunks = (z_len + planes_per_chunk - 1) / planes_per_chunk;
+            const size_t plane = x_len * y_len;
+            std::vector<ChunkEntry> index(fields.size() * num_chunks);
+            std::vector<std::vector<unsigned char>> blobs(index.size());
+            uint64_t offset = 24 + index.size() * sizeof(ChunkEntry);
+
+            for (size_t f = 0; f < fields.size(); f++) {
+                const size_t elem = TypeSize(fields[f].type);
+                const unsigned char * data = CheckpointField(cp, f);
+                if (!data) return false;
+                for (size_t c = 0; c < num_chunks; c++) {
+                    const size_t z_begin = c * planes_per_chunk;
+                    const size_t z_end = std::min(z_begin + planes_per_chunk, z_len);
+                    const unsigned char * raw = data + z_begin * plane * elem;
+                    const size_t raw_size = (z_end - z_begin) * plane * elem;
+                    ChunkEntry & entry = index[f * num_chunks + c];
+                    std::vector<unsigned char> & blob = blobs[f * num_chunks + c];
+
+                    entry.codec = RAW;
+#ifdef HCA_ZSTD
+                    if (compress) {
+                        blob.resize(ZSTD_compressBound(raw_size));
+                        const size_t size = ZSTD_compress(blob.data(), blob.size(), raw, raw_size, 3);
+                        if (!ZSTD_isError(size) && size < raw_size) {
+                            blob.resize(size);
+                            entry.codec = ZSTD;
+                        }
+                    }
+#endif
+                    if (entry.codec == RAW) {
+                        blob.assign(raw, raw + raw_size);
+                    }
+                    entry.offset = offset;
+                    entry.stored_size = blob.size();
+                    entry.raw_size = raw_size;
+                    entry.unused = 0;
+                    offset += blob.size();
+                }
+            }
+
+            const uint32_t unused = 0;
+            const uint64_t header[2] = {update, offset};
+            bool ok = std::fwrite(FRAME_MAGIC, 1, 4, file) == 4
+                      && std::fwrite(&unused, 4, 1, file) == 1
+                      && std::fwrite(header, 8, 2, file) == 2
+                      && std::fwrite(index.data(), sizeof(ChunkEntry), index.size(), file) == index.size();
+            for (const std::vector<unsigned char> & blob : blobs) {
+                ok = ok && std::fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+            }
+            ok = ok && std::fflush(file) == 0;
+            if (ok) good_end += offset;
+            return ok;
+        }
+
+        void WorkerLoop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [this](){return stopping || !queue.empty();});
+                if (queue.empty()) return;
+
+                std::pair<size_t, Checkpoint> frame = std::move(queue.front());
+                queue.pop_front();
+                busy = true;
+                cv.notify_all();
+
+                lock.unlock();
+                if (!failed && !WriteFrame(frame.first, frame.second)) {
+                    std::cerr << "Warning: could not write the snapshot for update " << frame.first << " to '"
+                              << filename << "'; no further snapshots will be written" << std::endl;
+                    failed = true;
+                }
+                lock.lock();
+                busy = false;
+                cv.notify_all();
+            }
+        }
+
+        public:
+        SnapshotWriter() {;}
+        SnapshotWriter(const SnapshotWriter &) = delete;
+        SnapshotWriter & operator=(const SnapshotWriter &) = delete;
+        ~SnapshotWriter() {Close();}
+
+        bool IsOpen() const {return file != nullptr;}
+
+        /// A frame could not be written, so the file stops at the frame
+        /// before it
+        bool HasFailed() const {return failed;}
+
+        /// Start a new file for an @param x by @param y by @param z grid,
+        /// with a field for each of the checkpoint's extra fields named in
+        /// @param extra_field_names. With @param resume_update other than
+        /// -1, keep the frames of an existing file with the same layout up
+        /// to that update and append after them (used when restarting from
+        /// a checkpoint).
+        bool Open(const std::string & in_filename, size_t x, size_t y, size_t z,
+                  size_t in_planes_per_chunk, bool in_compress,
+                  const std::vector<std::string> & extra_field_names = {}, size_t resume_update = (size_t)-1) {
+            Close();
+            filename = in_filename;
+            failed = false;
+            fields = CheckpointFields(extra_field_names);
+            x_len = x;
+            y_len = y;
+            z_len = z;
+            planes_per_chunk = std::max((size_t)1, in_planes_per_chunk);
+            compress = in_compress;
+#ifndef HCA_ZSTD
+            if (compress) {
+                std::cerr << "Warning: built without zstd (HCA_ZSTD); writing uncompressed snapshots" << std::endl;
+                compress = false;
+            }
+#endif
+
+            if (resume_update != (size_t)-1) {
+                SnapshotReader existing;
+                if (existing.Open(filename) && existing.GetXLen() == x && existing.GetYLen() == y
+                    && existing.GetZLen() == z && existing.GetPlanesPerChunk() == planes_per_chunk
+                    && SameFields(existing.GetFields(), fields)) {
+                    uint64_t keep = existing.GetEndOfFrames();
+                    for (size_t i = 0; i < existing.GetNumFrames(); i++) {
+                        if (existing.GetUpdate(i) > resume_update) {
+                            keep = existing.GetFrameOffset(i);
+                            break;
+                        }
+                    }
+                    existing.Close();
+                    std::error_code error;
+                    std::filesystem::resize_file(filename, keep, error);
+                    if (error) {
+                        std::cerr << "Warning: could not cut snapshot file '" << filename << "' back to update "
+                                  << resume_update << " (" << error.message() << ")" << std::endl;
+                        return false;
+                    }
+                    file = std::fopen(filename.c_str(), "ab");
+                    good_end = keep;
+                    return file != nullptr;
+                }
+            }
+
+            file = std::fopen(filename.c_str(), "wb");
+            if (!file) return false;
+            const uint32_t header[2] = {VERSION, (uint32_t)fields.size()};
+            const uint64_t dims[4] = {x_len, y_len, z_len, planes_per_chunk};
+            bool ok = std::fwrite(FILE_MAGIC, 1, 8, file) == 8
+                      && std::fwrite(header, 4, 2, file) == 2
+                      && std::fwrite(dims, 8, 4, file) == 4;
+            for (const FieldInfo & field : fields) {
+                char name[NAME_LEN] = {0};
+                std::strncpy(name, field.name.c_str(), NAME_LEN - 1);
+                ok = ok && std::fwrite(name, 1, NAME_LEN, file) == NAME_LEN
+                     && std::fwrite(&field.type, 4, 1, file) == 1;
+            }
+            good_end = 8 + sizeof(header) + sizeof(dims) + fields.size() * (NAME_LEN + 4);
+            if (!ok || std::fflush(file) != 0) {
+                std::fclose(file);
+                file = nullptr;
+                return false;
+            }
+            return true;
+        }
+
+        /// Queue the state in @param cp as the frame for @param update
+        void Submit(size_t update, Checkpoint && cp) {
+            if (failed) return;
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!worker.joinable()) {
+                worker = std::thread([this](){ WorkerLoop(); });
+            }
+            cv.wait(lock, [this](){return queue.size() < MAX_QUEUED;});
+            queue.emplace_back(update, std::move(cp));
+            cv.notify_all();
+        }
+
+        /// Write out everything queued and close the file
+        void Close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            if (worker.joinable()) worker.join();
+            stopping = false;
+            if (!file) return;
+            std::fclose(file);
+            file = nullptr;
+            if (failed) {
+                // Drop whatever part of the failed frame made it to disk
+                std::error_code error;
+                std::filesystem::resize_file(filename, good_end, error);
+            }
+        }
+    };
+}
+
+#endif
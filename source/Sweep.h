@@ -0,0 +1,304 @@
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "HCAGridWorld.h"
+
+/// Runs many replicates and parameter combinations in one process, one
+/// world per job, on NUM_THREADS threads. The sweep file is either
+///
+///   a grid: one line per swept setting with its values, and all
+///   combinations are run, e.g.
+///       DRUG_CONCENTRATION 0.05 0.1 0.2
+///       KM 0.01 0.1
+///
+///   or a list: a comma-separated header of setting names followed by one
+///   line of values per parameter point, e.g.
+///       DRUG_CONCENTRATION,KM
+///       0.05,0.01
+///       0.2,0.1
+///
+/// Lines starting with # are ignored, and a "REPLICATES n" line (in either
+/// format) runs every point n times. All other settings come from the
+/// base config. Run i uses SEED + i, so any run can be repeated on its own
+/// with that seed.
+///
+/// Every DATA_RESOLUTION updates each run adds a row to one CSV file with
+/// the swept values and population statistics. Rows are written in run
+/// order whatever order the runs finish in. Per-run output files
+/// (population, checkpoints, snapshots, traces) are turned off.
+class SweepRunner {
+  emp::vector<std::string> names;                // Swept settings
+  emp::vector<emp::vector<std::string>> points;  // Values of each point
+  size_t replicates = 1;
+
+  std::mutex mutex;
+  emp::vector<std::string> results; // Rows of each run, once it is done
+  emp::vector<bool> finished;
+  size_t next_to_write = 0;
+  size_t num_finished = 0;
+
+  static emp::vector<std::string> Split(const std::string & line, char sep) {
+    emp::vector<std::string> parts;
+    std::stringstream ss(line);
+    std::string part;
+    if (sep == ' ') {
+      while (ss >> part) parts.push_back(part);
+    } else {
+      while (std::getline(ss, part, sep)) {
+        part.erase(0, part.find_first_not_of(" \t"));
+        part.erase(part.find_last_not_of(" \t\r") + 1);
+        parts.push_back(part);
+      }
+    }
+    return parts;
+  }
+
+  /// Names of every setting in @param config
+  static emp::vector<std::string> SettingNames(PublicGoodsConfig & config) {
+    std::stringstream ss;
+    config.Write(ss);
+    emp::vector<std::string> setting_names;
+    std::string line;
+    while (std::getline(ss, line)) {
+      const emp::vector<std::string> words = Split(line, ' ');
+      if (words.size() >= 2 && words[0] == "set") setting_names.push_back(words[1]);
+    }
+    return setting_names;
+  }
+
+  /// Whether all of @param text is a number
+  static bool IsNumber(const std::string & text) {
+    char * end = nullptr;
+    std::strtod(text.c_str(), &end);
+    return !text.empty() && end == text.c_str() + text.size();
+  }
+
+  /// Check the sweep value @param val for setting @param name, from line
+  /// @param line_num of @param filename: settings that hold a number in
+  /// @param config only take numbers
+  static bool CheckValue(PublicGoodsConfig & config, const std::string & name, const std::string & val,
+                         const std::string & filename, size_t line_num) {
+    if (!config.Has(name)) {
+      std::cerr << "Error: unknown setting '" << name << "' on line " << line_num << " of sweep file '"
+                << filename << "'" << std::endl;
+      return false;
+    }
+    if (IsNumber(config.Get(name)) && !IsNumber(val)) {
+      std::cerr << "Error: '" << val << "' on line " << line_num << " of sweep file '" << filename
+                << "' is not a number, as " << name << " needs" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Run @param run with a WORLD engine and @return its CSV rows
+  template <typename WORLD>
+  std::string RunOne(PublicGoodsConfig & config, size_t run, int seed) {
+    emp::Random rnd(seed);
+    WORLD world(rnd);
+    world.SetShowProgress(false);
+    world.Setup(config);
+
+    const size_t point = run / replicates;
+    std::string prefix = std::to_string(run) + "," + std::to_string(point) + ","
+                         + std::to_string(run % replicates) + "," + std::to_string(seed);
+    for (const std::string & val : points[point]) {
+      prefix += "," + val;
+    }
+
+    std::stringstream rows;
+    const size_t resolution = (size_t)std::max(config.DATA_RESOLUTION(), 1);
+    const int time_steps = config.TIME_STEPS();
+    for (int u = (int)world.GetUpdate(); u <= time_steps; u++) {
+      world.RunStep();
+      const size_t update = world.GetUpdate();
+      if (update % resolution != 0 && u != time_steps) continue;
+
+      size_t cells = 0, producers = 0;
+      double resistance = 0, public_good = 0;
+      const size_t size = world.GetSize();
+      for (size_t cell_id = 0; cell_id < size; cell_id++) {
+        public_good += world.GetCellPublicGood(cell_id);
+        if (!world.IsOccupied(cell_id)) continue;
+        const Cell & cell = world.GetOrg(cell_id);
+        cells++;
+        producers += cell.producer;
+        resistance += cell.resistance;
+      }
+      rows << prefix << "," << update << "," << cells << "," << producers << ","
+           << (cells ? resistance / (double)cells : 0) << "," << public_good / (double)size << "\n";
+    }
+    return rows.str();
+  }
+
+  /// Store the rows of @param run and write out every run that is now
+  /// next in order
+  void Finish(size_t run, std::string && rows, std::ostream & out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    results[run] = std::move(rows);
+    finished[run] = true;
+    while (next_to_write < finished.size() && finished[next_to_write]) {
+      out << results[next_to_write];
+      results[next_to_write].clear();
+      next_to_write++;
+    }
+    out.flush();
+    Logger::Get().Progress(++num_finished);
+  }
+
+  public:
+  SweepRunner() {;}
+
+  size_t GetNumRuns() const {return points.size() * replicates;}
+
+  /// Read the sweep from @param filename, checking setting names against
+  /// @param config
+  bool Load(const std::string & filename, PublicGoodsConfig & config) {
+    std::ifstream in(filename);
+    if (!in) {
+      std::cerr << "Error: could not read sweep file '" << filename << "'" << std::endl;
+      return false;
+    }
+
+    emp::vector<emp::vector<std::string>> axes; // Grid format: values per setting
+    bool list = false;
+    std::string line;
+    size_t line_num = 0;
+    while (std::getline(in, line)) {
+      line_num++;
+      const size_t start = line.find_first_not_of(" \t\r");
+      if (start == std::string::npos || line[start] == '#') continue;
+
+      const emp::vector<std::string> words = Split(line, ' ');
+      if (words[0] == "REPLICATES" && words.size() == 2) {
+        char * end = nullptr;
+        const long count = std::strtol(words[1].c_str(), &end, 10);
+        if (*end != '\0' || count < 1) {
+          std::cerr << "Error: REPLICATES on line " << line_num << " of sweep file '" << filename
+                    << "' needs a whole number of at least 1, not '" << words[1] << "'" << std::endl;
+          return false;
+        }
+        replicates = (size_t)count;
+      } else if (list) {
+        emp::vector<std::string> vals = Split(line, ',');
+        if (vals.size() != names.size()) {
+          std::cerr << "Error: line " << line_num << " of sweep file '" << filename << "' needs "
+                    << names.size() << " values" << std::endl;
+          return false;
+        }
+        for (size_t i = 0; i < vals.size(); i++) {
+          if (!CheckValue(config, names[i], vals[i], filename, line_num)) return false;
+        }
+        points.push_back(vals);
+      } else if (names.empty() && line.find(',') != std::string::npos) {
+        list = true;
+        names = Split(line, ',');
+        for (const std::string & name : names) {
+          if (!config.Has(name)) {
+            std::cerr << "Error: unknown setting '" << name << "' on line " << line_num << " of sweep file '"
+                      << filename << "'" << std::endl;
+            return false;
+          }
+        }
+      } else {
+        names.push_back(words[0]);
+        axes.emplace_back(words.begin() + 1, words.end());
+        if (axes.back().empty()) {
+          std::cerr << "Error: no values for '" << words[0] << "' on line " << line_num << " of sweep file '"
+                    << filename << "'" << std::endl;
+          return false;
+        }
+        for (const std::string & val : axes.back()) {
+          if (!CheckValue(config, words[0], val, filename, line_num)) return false;
+        }
+      }
+    }
+
+    if (!list) {
+      // Every combination, the last setting varying fastest
+      points.assign(1, {});
+      for (const emp::vector<std::string> & axis : axes) {
+        emp::vector<emp::vector<std::string>> expanded;
+        for (const emp::vector<std::string> & point : points) {
+          for (const std::string & val : axis) {
+            expanded.push_back(point);
+            expanded.back().push_back(val);
+          }
+        }
+        points = expanded;
+      }
+    }
+    return true;
+  }
+
+  /// Run every job with the settings of @param base, writing the combined
+  /// results to @param output_file
+  bool Run(PublicGoodsConfig & base, const std::string & output_file) {
+    std::ofstream out(output_file);
+    if (!out) {
+      std::cerr << "Error: could not write sweep output '" << output_file << "'" << std::endl;
+      return false;
+    }
+    out << "run,point,replicate,seed";
+    for (const std::string & name : names) out << "," << name;
+    out << ",update,cells,producers,mean_resistance,mean_public_good\n";
+
+    if (base.CHECKPOINT_INTERVAL() > 0 || base.SNAPSHOT_FILE() != "" || base.PROFILE_TRACE_FILE() != "") {
+      std::cerr << "Warning: checkpoints, snapshots and traces are not written during sweeps" << std::endl;
+    }
+
+    size_t threads = base.NUM_THREADS();
+#if defined(EMP_TRACK_MEM) || defined(HCA_PROFILE)
+    // Pointer tracking and the profiler keep process-wide state
+    threads = 1;
+#endif
+    ThreadPool pool(threads);
+
+    const emp::vector<std::string> setting_names = SettingNames(base);
+    const int base_seed = base.SEED() > 0 ? base.SEED() : 1 + (int)(std::random_device()() >> 2);
+    Logger::Get().Printf(Logger::SUMMARY, "Sweep of %zu runs from seed %d", GetNumRuns(), base_seed);
+    const bool grid = base.WORLD_ENGINE() == "grid";
+
+    const size_t num_runs = GetNumRuns();
+    results.assign(num_runs, "");
+    finished.assign(num_runs, false);
+    next_to_write = 0;
+    num_finished = 0;
+    Logger::Get().StartProgress(0, num_runs, "run");
+
+    pool.ParallelForDynamic(0, num_runs, [&](size_t run){
+      PublicGoodsConfig config;
+      for (const std::string & name : setting_names) {
+        config.Set(name, base.Get(name));
+      }
+      const emp::vector<std::string> & point = points[run / replicates];
+      for (size_t i = 0; i < names.size(); i++) {
+        config.Set(names[i], point[i]);
+      }
+      const int seed = base_seed + (int)run;
+      config.Set("SEED", std::to_string(seed));
+      config.Set("NUM_THREADS", "1");
+      config.Set("POPULATION_FILE", "");
+      config.Set("CHECKPOINT_INTERVAL", "0");
+      config.Set("SNAPSHOT_FILE", "");
+      config.Set("PROFILE_TRACE_FILE", "");
+
+      std::string rows = grid ? RunOne<HCAGridWorld>(config, run, seed) : RunOne<HCAWorld>(config, run, seed);
+      Finish(run, std::move(rows), out);
+    });
+
+    Logger::Get().FinishProgress(num_runs);
+    return (bool)out;
+  }
+};
+
+#endif
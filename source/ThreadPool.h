@@ -0,0 +1,129 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Persistent fork-join pool. The calling thread always takes part in the
+/// work, so a pool of size 1 never starts a thread at all (which keeps the
+/// single-threaded and web builds free of any threading).
+class ThreadPool {
+  public:
+  using task_t = std::function<void(size_t)>;
+  using range_fun_t = std::function<void(size_t, size_t)>;
+
+  private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  const task_t * task = nullptr;
+  size_t generation = 0;
+  size_t pending = 0;
+  bool stopping = false;
+
+  void WorkerLoop(size_t thread_id) {
+    size_t seen = 0;
+    while (true) {
+      const task_t * job = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start_cv.wait(lock, [&](){return stopping || generation != seen;});
+        if (stopping) return;
+        seen = generation;
+        job = task;
+      }
+      (*job)(thread_id);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) done_cv.notify_one();
+      }
+    }
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    start_cv.notify_all();
+    for (std::thread & t : workers) t.join();
+    workers.clear();
+    stopping = false;
+  }
+
+  public:
+  ThreadPool(size_t num_threads=1) { SetNumThreads(num_threads); }
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+  ~ThreadPool() { Stop(); }
+
+  /// Total number of threads that work on each job, including the caller.
+  /// Passing 0 uses every hardware thread.
+  void SetNumThreads(size_t num_threads) {
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (num_threads == GetNumThreads()) return;
+    Stop();
+    generation = 0;
+    for (size_t i = 1; i < num_threads; i++) {
+      workers.emplace_back([this, i](){ WorkerLoop(i); });
+    }
+  }
+
+  size_t GetNumThreads() const { return workers.size() + 1; }
+
+  /// Run @param fn once on every thread (with ids 0 .. GetNumThreads()-1)
+  /// and return once all of them have finished.
+  void Run(const task_t & fn) {
+    if (workers.empty()) {
+      fn(0);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      task = &fn;
+      pending = workers.size();
+      generation++;
+    }
+    start_cv.notify_all();
+    fn(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&](){return pending == 0;});
+  }
+
+  /// Split [begin, end) into one contiguous chunk per thread and call
+  /// @param fn(chunk_begin, chunk_end) on each. Chunk boundaries depend
+  /// only on the range and the thread count.
+  void ParallelFor(size_t begin, size_t end, const range_fun_t & fn) {
+    if (end <= begin) return;
+    const size_t len = end - begin;
+    const size_t num_chunks = std::min(GetNumThreads(), len);
+    if (num_chunks == 1) {
+      fn(begin, end);
+      return;
+    }
+    Run([&](size_t thread_id){
+      if (thread_id >= num_chunks) return;
+      fn(begin + len * thread_id / num_chunks, begin + len * (thread_id + 1) / num_chunks);
+    });
+  }
+
+  /// Call @param fn(i) for every i in [begin, end), handing out one index
+  /// at a time to whichever thread is free. For independent jobs of
+  /// uneven length; which thread runs which job is not deterministic.
+  void ParallelForDynamic(size_t begin, size_t end, const task_t & fn) {
+    std::atomic<size_t> next(begin);
+    Run([&](size_t){
+      for (size_t i = next++; i < end; i = next++) {
+        fn(i);
+      }
+    });
+  }
+};
+
+#endif
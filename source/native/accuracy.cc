@@ -0,0 +1,159 @@
+// Compares float public good fields (PUBLIC_GOOD_PRECISION float, with and
+// without PUBLIC_GOOD_COMPENSATED) against double on the default settings
+// over a few grid sizes.
+//
+//   accuracy [-quick] [-updates N]
+//
+// Two comparisons per grid:
+//   diffusion: the initial population is kept fixed while the public good
+//     runs for N updates, so the fields differ only by rounding.
+//   model: complete runs from the same seed. Cell fates read the field, so
+//     once a death draw lands between the float and double probabilities
+//     the populations part ways; the first update where they differ is
+//     reported along with the final field and population.
+// Field errors are relative to the mean of the double field.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../public_goods_model.h"
+
+struct Variant {
+  std::string name;
+  std::string precision;
+  bool compensated;
+};
+
+struct FieldError {
+  double max_rel = 0;
+  double mean_rel = 0;
+};
+
+/// Error of @param test against @param ref, relative to ref's mean
+FieldError Compare(const Checkpoint & ref, const Checkpoint & test) {
+  double mean = 0;
+  for (double val : ref.curr_field) mean += val;
+  mean /= (double)ref.curr_field.size();
+
+  FieldError err;
+  for (size_t i = 0; i < ref.curr_field.size(); i++) {
+    const double diff = std::abs(test.curr_field[i] - ref.curr_field[i]);
+    err.max_rel = std::max(err.max_rel, diff);
+    err.mean_rel += diff;
+  }
+  err.mean_rel /= (double)ref.curr_field.size();
+  if (mean > 0) {
+    err.max_rel /= mean;
+    err.mean_rel /= mean;
+  }
+  return err;
+}
+
+size_t CountCells(const Checkpoint & cp) {
+  size_t count = 0;
+  for (unsigned char occupied : cp.occupied) count += occupied;
+  return count;
+}
+
+bool SamePopulation(const Checkpoint & a, const Checkpoint & b) {
+  return a.occupied == b.occupied && a.producer == b.producer;
+}
+
+PublicGoodsConfig MakeConfig(size_t x, size_t y, size_t z, const Variant & variant) {
+  PublicGoodsConfig config;
+  config.Set("WORLD_X", std::to_string(x));
+  config.Set("WORLD_Y", std::to_string(y));
+  config.Set("WORLD_Z", std::to_string(z));
+  config.Set("SEED", "1");
+  config.Set("POPULATION_FILE", "");
+  config.Set("PUBLIC_GOOD_PRECISION", variant.precision);
+  config.Set("PUBLIC_GOOD_COMPENSATED", variant.compensated ? "1" : "0");
+  return config;
+}
+
+int main(int argc, char* argv[])
+{
+  int updates = 200;
+  bool quick = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-quick") {
+      quick = true;
+    } else if (arg == "-updates" && i + 1 < argc) {
+      updates = std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-quick] [-updates N]" << std::endl;
+      return 1;
+    }
+  }
+  Logger::Get().SetLevel(Logger::QUIET);
+
+  struct Size {size_t x, y, z;};
+  std::vector<Size> sizes = {{100, 100, 1}, {50, 50, 50}};
+  if (!quick) {
+    sizes.push_back({100, 100, 100});
+  }
+  const std::vector<Variant> variants = {{"float", "float", false}, {"float+compensated", "float", true}};
+  const Variant reference{"double", "double", false};
+
+  std::cout << "grid\tcomparison\tprecision\tmax rel error\tmean rel error\tcells (double)\tcells\tfirst divergence" << std::endl;
+  for (const Size & size : sizes) {
+    const std::string grid = std::to_string(size.x) + "x" + std::to_string(size.y) + "x" + std::to_string(size.z);
+
+    // Diffusion only
+    PublicGoodsConfig ref_config = MakeConfig(size.x, size.y, size.z, reference);
+    emp::Random ref_rnd(1);
+    HCAWorld ref_world(ref_rnd);
+    ref_world.Setup(ref_config);
+    ref_world.UpdatePublicGood(updates * ref_config.DIFFUSION_STEPS_PER_TIME_STEP());
+    const Checkpoint ref_field = ref_world.GetCheckpoint();
+
+    for (const Variant & variant : variants) {
+      PublicGoodsConfig config = MakeConfig(size.x, size.y, size.z, variant);
+      emp::Random rnd(1);
+      HCAWorld world(rnd);
+      world.Setup(config);
+      world.UpdatePublicGood(updates * config.DIFFUSION_STEPS_PER_TIME_STEP());
+      const FieldError err = Compare(ref_field, world.GetCheckpoint());
+      std::cout << grid << "\tdiffusion\t" << variant.name << "\t" << err.max_rel << "\t" << err.mean_rel
+                << "\t-\t-\t-" << std::endl;
+    }
+
+    // Whole model, stepping the runs side by side
+    std::vector<emp::Ptr<emp::Random>> rnds;
+    std::vector<emp::Ptr<HCAWorld>> worlds;
+    std::vector<size_t> diverged;
+    for (size_t v = 0; v <= variants.size(); v++) {
+      PublicGoodsConfig config = MakeConfig(size.x, size.y, size.z, v == 0 ? reference : variants[v - 1]);
+      rnds.push_back(emp::NewPtr<emp::Random>(1));
+      worlds.push_back(emp::NewPtr<HCAWorld>(*rnds.back()));
+      worlds.back()->SetShowProgress(false);
+      worlds.back()->Setup(config);
+      diverged.push_back(0);
+    }
+    for (int u = 0; u < updates; u++) {
+      for (emp::Ptr<HCAWorld> world : worlds) world->RunStep();
+      const Checkpoint ref = worlds[0]->GetCheckpoint();
+      for (size_t v = 1; v < worlds.size(); v++) {
+        if (!diverged[v] && !SamePopulation(ref, worlds[v]->GetCheckpoint())) diverged[v] = worlds[v]->GetUpdate();
+      }
+    }
+    const Checkpoint ref = worlds[0]->GetCheckpoint();
+    for (size_t v = 1; v < worlds.size(); v++) {
+      const Checkpoint cp = worlds[v]->GetCheckpoint();
+      const FieldError err = Compare(ref, cp);
+      std::cout << grid << "\tmodel\t" << variants[v - 1].name << "\t" << err.max_rel << "\t" << err.mean_rel
+                << "\t" << CountCells(ref) << "\t" << CountCells(cp) << "\t"
+                << (diverged[v] ? std::to_string(diverged[v]) : std::string("none")) << std::endl;
+    }
+    for (size_t v = 0; v < worlds.size(); v++) {
+      worlds[v].Delete();
+      rnds[v].Delete();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Benchmarks the model's hot kernels over a sweep of grid sizes.
+//
+//   benchmark [-quick] [-reps N] [-threads N] [-float] [-json FILE]
+//
+// Every kernel is timed in several samples, each long enough to cover
+// timer noise; the table and the JSON report the mean, spread and
+// throughput per sample. bytes/voxel is the nominal memory traffic of one
+// call per voxel (or per cell, for CanDivide), so voxels/s * bytes/voxel
+// approximates the bandwidth a kernel achieves. For RunStep it is the
+// resident model state per voxel instead. -float runs the public good at
+// PUBLIC_GOOD_PRECISION float.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../public_goods_model.h"
+
+/// HCAWorld with its per-phase methods opened up for timing
+class BenchWorld : public HCAWorld {
+  public:
+  BenchWorld(emp::Random & rnd) : HCAWorld(rnd) {;}
+
+  using HCAWorld::CanDivide;
+  using HCAModelBase::BasalPublicGoodConsumption;
+  using HCAModelBase::RefreshCellMasks;
+
+  const OccupancyBitset & GetOccupiedBits() const {return occupied_bits;}
+};
+
+struct Result {
+  std::string kernel;
+  size_t x, y, z;
+  size_t items;          // Voxels (or cells) processed per call
+  double bytes_per_item;
+  size_t iterations;     // Calls per sample
+  std::vector<double> samples; // Seconds per call
+
+  double Mean() const {
+    double sum = 0;
+    for (double s : samples) sum += s;
+    return sum / (double)samples.size();
+  }
+
+  double StdDev() const {
+    const double mean = Mean();
+    double sum = 0;
+    for (double s : samples) sum += (s - mean) * (s - mean);
+    return samples.size() > 1 ? std::sqrt(sum / (double)(samples.size() - 1)) : 0;
+  }
+
+  double Min() const {return *std::min_element(samples.begin(), samples.end());}
+
+  double Median() const {
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    const size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+  }
+
+  double ItemsPerSecond() const {return (double)items / Median();}
+};
+
+/// Time @param fn: one warm-up call, then @param reps samples of enough
+/// calls to take at least @param min_sample seconds each.
+Result Time(const std::string & kernel, size_t x, size_t y, size_t z, size_t items, double bytes_per_item,
+            int reps, double min_sample, const std::function<void()> & fn) {
+  using clock = std::chrono::steady_clock;
+  Result result{kernel, x, y, z, items, bytes_per_item, 1, {}};
+
+  const clock::time_point warm_start = clock::now();
+  fn();
+  const double once = std::chrono::duration<double>(clock::now() - warm_start).count();
+  result.iterations = once > 0 ? std::max((size_t)1, (size_t)std::ceil(min_sample / once)) : 1000;
+
+  for (int rep = 0; rep < reps; rep++) {
+    const clock::time_point start = clock::now();
+    for (size_t i = 0; i < result.iterations; i++) {
+      fn();
+    }
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    result.samples.push_back(elapsed / (double)result.iterations);
+  }
+
+  std::cout << kernel << "\t" << x << "x" << y << "x" << z << "\t" << result.Mean() * 1e3 << " ms\t+- "
+            << (result.Mean() > 0 ? 100 * result.StdDev() / result.Mean() : 0) << "%\t"
+            << result.ItemsPerSecond() / 1e6 << " M/s\t"
+            << result.ItemsPerSecond() * bytes_per_item / 1e9 << " GB/s" << std::endl;
+  return result;
+}
+
+void WriteJSON(const std::string & filename, const std::vector<Result> & results, size_t threads,
+               const std::string & precision) {
+  std::ofstream out(filename);
+  out << "{\n  \"threads\": " << threads << ",\n";
+  out << "  \"precision\": \"" << precision << "\",\n";
+#ifdef __VERSION__
+  out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+  out << "  \"benchmarks\": [\n";
+  out.precision(9);
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result & r = results[i];
+    out << "    {\"kernel\": \"" << r.kernel << "\", \"x\": " << r.x << ", \"y\": " << r.y << ", \"z\": " << r.z
+        << ", \"items\": " << r.items << ", \"iterations\": " << r.iterations
+        << ", \"samples\": " << r.samples.size()
+        << ", \"mean_s\": " << r.Mean() << ", \"stddev_s\": " << r.StdDev()
+        << ", \"variance_s2\": " << r.StdDev() * r.StdDev()
+        << ", \"min_s\": " << r.Min() << ", \"median_s\": " << r.Median()
+        << ", \"items_per_s\": " << r.ItemsPerSecond() << ", \"bytes_per_item\": " << r.bytes_per_item
+        << ", \"gb_per_s\": " << r.ItemsPerSecond() * r.bytes_per_item / 1e9 << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+  int reps = 5;
+  size_t threads = 1;
+  bool quick = false;
+  std::string precision = "double";
+  std::string json_file;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-quick") {
+      quick = true;
+    } else if (arg == "-reps" && i + 1 < argc) {
+      reps = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-threads" && i + 1 < argc) {
+      threads = (size_t)std::atol(argv[++i]);
+    } else if (arg == "-float") {
+      precision = "float";
+    } else if (arg == "-json" && i + 1 < argc) {
+      json_file = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-quick] [-reps N] [-threads N] [-float] [-json FILE]" << std::endl;
+      return 1;
+    }
+  }
+
+  struct Size {size_t x, y, z;};
+  std::vector<Size> sizes = {{100, 100, 1}, {50, 50, 50}, {100, 100, 100}};
+  if (!quick) {
+    sizes.push_back({200, 200, 200});
+  }
+  const double min_sample = quick ? 0.02 : 0.1;
+
+  std::vector<Result> results;
+  for (const Size & size : sizes) {
+    const size_t voxels = size.x * size.y * size.z;
+
+    PublicGoodsConfig config;
+    config.Set("WORLD_X", std::to_string(size.x));
+    config.Set("WORLD_Y", std::to_string(size.y));
+    config.Set("WORLD_Z", std::to_string(size.z));
+    config.Set("INIT_POP_SIZE", std::to_string(voxels / 2));
+    config.Set("INITIAL_PUBLIC_GOOD_LEVEL", "0.5");
+    config.Set("NUM_THREADS", std::to_string(threads));
+    config.Set("SEED", "1");
+    config.Set("POPULATION_FILE", "");
+    config.Set("PUBLIC_GOOD_PRECISION", precision);
+
+    emp::Random rnd(1);
+    BenchWorld world(rnd);
+    world.Setup(config);
+    const size_t cells = world.GetOccupiedBits().Count();
+    volatile double sink = 0;
+
+    // Bytes per voxel of one field value
+    double field_bytes = 8;
+    world.WithPublicGood([&](auto & grad){
+      field_bytes = sizeof(typename std::decay_t<decltype(grad)>::value_t);
+      results.push_back(Time("ResourceGradient::Diffuse", size.x, size.y, size.z, voxels, 2 * field_bytes, reps,
+                             min_sample, [&grad](){ grad.Diffuse(); }));
+      results.push_back(Time("ResourceGradient::Update", size.x, size.y, size.z, voxels, 3 * field_bytes, reps,
+                             min_sample, [&grad](){ grad.Update(); }));
+
+      results.push_back(Time("ResourceGradient::GetNeighborOxygen", size.x, size.y, size.z, voxels, field_bytes, reps,
+                             min_sample, [&grad, &size, &sink](){
+        double total = 0;
+        for (size_t z = 0; z < size.z; z++) {
+          for (size_t y = 0; y < size.y; y++) {
+            for (size_t x = 0; x < size.x; x++) {
+              total += grad.GetNeighborOxygen(x, y, z);
+            }
+          }
+        }
+        sink = total;
+      }));
+    });
+
+    // Reads the voxel's neighbor class and 26 occupancy bits, mostly cached
+    results.push_back(Time("HCAWorld::CanDivide", size.x, size.y, size.z, cells, 1, reps, min_sample,
+                           [&world, &sink](){
+      long total = 0;
+      const OccupancyBitset & bits = world.GetOccupiedBits();
+      bits.ForEachSet(0, bits.size(), [&world, &total](size_t cell_id){
+        total += world.CanDivide(cell_id);
+      });
+      sink = (double)total;
+    }));
+
+    // Streams the occupancy bits and updates next for each occupied voxel
+    world.RefreshCellMasks();
+    results.push_back(Time("HCAWorld::BasalPublicGoodConsumption", size.x, size.y, size.z, voxels, 2 * field_bytes, reps, min_sample,
+                           [&world](){ world.BasalPublicGoodConsumption(); }));
+
+    // One diffusion step with sources and sinks on the configured path
+    results.push_back(Time("HCAWorld::UpdatePublicGood", size.x, size.y, size.z, voxels, 3 * field_bytes, reps, min_sample,
+                           [&world](){ world.UpdatePublicGood(); }));
+
+    // The same step with EXTRA_FIELDS, which the one sweep updates as well
+    for (size_t extra : {1, 3}) {
+      std::string fields;
+      for (size_t f = 0; f < extra; f++) {
+        fields += (f ? ";" : "") + std::string("field") + std::to_string(f) + ":1:0.05:0:0:0.05:0.01:0.5";
+      }
+      config.Set("EXTRA_FIELDS", fields);
+      emp::Random fields_rnd(1);
+      BenchWorld fields_world(fields_rnd);
+      fields_world.Setup(config);
+      results.push_back(Time("HCAWorld::UpdatePublicGood, " + std::to_string(extra + 1) + " fields", size.x, size.y, size.z,
+                             voxels, 3 * field_bytes * (double)(extra + 1), reps, min_sample,
+                             [&fields_world](){ fields_world.UpdatePublicGood(); }));
+    }
+    config.Set("EXTRA_FIELDS", "");
+
+    // Field (curr + next), population and next population pointers,
+    // masks, neighbor class and occupancy bits
+    results.push_back(Time("HCAWorld::RunStep", size.x, size.y, size.z, voxels, 2 * field_bytes + 16 + 2 + 1 + 0.25, reps, min_sample,
+                           [&world](){ world.RunStep(); }));
+  }
+
+  if (json_file != "") {
+    WriteJSON(json_file, results, threads, precision);
+    std::cout << "Wrote " << json_file << std::endl;
+  }
+  return 0;
+}
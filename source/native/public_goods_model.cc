@@ -1,28 +1,79 @@
 // This is the main function for the NATIVE version of this project.
 
 #include <iostream>
+#include <random>
+#include <sstream>
 
 #include "../public_goods_model.h"
+#include "../HCAGridWorld.h"
+#include "../HCASlabWorld.h"
+#include "../Sweep.h"
 #include "base/vector.h"
 #include "config/command_line.h"
 
 int main(int argc, char* argv[])
 {
+  SlabComm comm(argc, argv); // MPI, for WORLD_ENGINE slab in builds with USE_MPI=1
   PublicGoodsConfig config;
   auto args = emp::cl::ArgManager(argc, argv);
+  std::string restart_file;
+  args.UseArg("-restart", restart_file, "Checkpoint file (see CHECKPOINT_INTERVAL) to continue a run from");
+  std::string sweep_file;
+  std::string sweep_output = "sweep.csv";
+  args.UseArg("-sweep", sweep_file, "Parameter grid or list to run as a batch (see source/Sweep.h)");
+  args.UseArg("-sweep_output", sweep_output, "CSV file for the combined results of -sweep");
   if (args.ProcessConfigOptions(config, std::cout, "PublicGoodsConfig.cfg", "Memic-macros.h") == false) exit(0);
   if (args.TestUnknown() == false) exit(0);  // If there are leftover args, throw an error.
 
   // Write to screen how the experiment is configured
-  std::cout << "==============================" << std::endl;
-  std::cout << "|    How am I configured?    |" << std::endl;
-  std::cout << "==============================" << std::endl;
-  config.Write(std::cout);
-  std::cout << "==============================\n" << std::endl;
+  Logger & log = Logger::Get();
+  log.SetLevel(comm.IsRoot() ? config.VERBOSITY() : (int)Logger::QUIET);
+  log.SetProgressInterval(config.PROGRESS_INTERVAL());
+  if (log.Enabled(Logger::SUMMARY)) {
+    std::stringstream config_text;
+    config_text << "==============================" << std::endl;
+    config_text << "|    How am I configured?    |" << std::endl;
+    config_text << "==============================" << std::endl;
+    config.Write(config_text);
+    config_text << "==============================\n" << std::endl;
+    log.Write(Logger::SUMMARY, config_text.str());
+  }
+
+  if (sweep_file != "") {
+    SweepRunner sweep;
+    if (!sweep.Load(sweep_file, config) || !sweep.Run(config, sweep_output)) exit(1);
+    return 0;
+  }
 
   emp::Random rnd(config.SEED());
 
+  if (config.WORLD_ENGINE() == "grid") {
+    HCAGridWorld world(rnd);
+    world.Setup(config);
+    if (restart_file != "" && !world.LoadCheckpoint(restart_file)) exit(1);
+    world.Run();
+    return 0;
+  }
+  if (config.WORLD_ENGINE() == "slab") {
+    if (restart_file != "") {
+      std::cerr << "Error: -restart is not supported with WORLD_ENGINE slab" << std::endl;
+      return 1;
+    }
+    // Every process needs the same seed
+    int seed = config.SEED() > 0 ? config.SEED() : 1 + (int)(std::random_device()() >> 2);
+    comm.Broadcast(&seed, sizeof(seed));
+    rnd.ResetSeed(seed);
+    HCASlabWorld world(rnd, comm);
+    if (!world.Setup(config)) return 1;
+    world.Run();
+    return 0;
+  }
+  if (config.WORLD_ENGINE() != "emp") {
+    std::cerr << "Warning: unknown WORLD_ENGINE '" << config.WORLD_ENGINE() << "'; using emp" << std::endl;
+  }
+
   HCAWorld world(rnd);
   world.Setup(config);
+  if (restart_file != "" && !world.LoadCheckpoint(restart_file)) exit(1);
   world.Run();
 }
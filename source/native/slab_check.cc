@@ -0,0 +1,82 @@
+// Checks WORLD_ENGINE slab against the grid engine, for a build with
+// USE_MPI=1 run on several local processes (make slab-check):
+//
+//   mpirun -np N slab_check [-updates U] [-x X] [-y Y] [-z Z]
+//
+// The slab run is gathered onto the root, which then runs the same config
+// on one HCAGridWorld with PARALLEL_CELL_UPDATE and compares the two
+// exactly: public good grids, every cell, and the population totals.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../HCASlabWorld.h"
+
+PublicGoodsConfig MakeConfig(size_t x, size_t y, size_t z, int updates) {
+  PublicGoodsConfig config;
+  config.Set("WORLD_X", std::to_string(x));
+  config.Set("WORLD_Y", std::to_string(y));
+  config.Set("WORLD_Z", std::to_string(z));
+  config.Set("TIME_STEPS", std::to_string(updates - 1));
+  config.Set("INIT_POP_SIZE", std::to_string(x * y * z / 50));
+  config.Set("DRUG_CONCENTRATION", "0.25");
+  config.Set("PARALLEL_CELL_UPDATE", "1");
+  config.Set("SEED", "1");
+  config.Set("POPULATION_FILE", "");
+  return config;
+}
+
+bool SameCheckpoint(const Checkpoint & a, const Checkpoint & b) {
+  return a.update == b.update && a.curr_field == b.curr_field && a.next_field == b.next_field
+         && a.occupied == b.occupied && a.producer == b.producer && a.age == b.age && a.resistance == b.resistance;
+}
+
+int main(int argc, char* argv[])
+{
+  SlabComm comm(argc, argv);
+  int updates = 30;
+  size_t x = 40, y = 40, z = 64;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-updates" && i + 1 < argc) {
+      updates = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-x" && i + 1 < argc) {
+      x = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-y" && i + 1 < argc) {
+      y = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-z" && i + 1 < argc) {
+      z = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else {
+      if (comm.IsRoot()) std::cerr << "Usage: " << argv[0] << " [-updates U] [-x X] [-y Y] [-z Z]" << std::endl;
+      return 1;
+    }
+  }
+  Logger::Get().SetLevel(Logger::QUIET);
+
+  PublicGoodsConfig config = MakeConfig(x, y, z, updates);
+  emp::Random rnd(1);
+  HCASlabWorld slab(rnd, comm);
+  slab.SetShowProgress(false);
+  if (!slab.Setup(config)) return 1;
+  slab.Run();
+  const HCASlabWorld::Stats stats = slab.GetGlobalStats();
+  const Checkpoint gathered = slab.GatherCheckpoint();
+  if (!comm.IsRoot()) return 0;
+
+  PublicGoodsConfig grid_config = MakeConfig(x, y, z, updates);
+  emp::Random grid_rnd(1);
+  HCAGridWorld grid(grid_rnd);
+  grid.SetShowProgress(false);
+  grid.Setup(grid_config);
+  grid.Run();
+  const Checkpoint expected = grid.GetCheckpoint();
+
+  const bool same = SameCheckpoint(gathered, expected);
+  const bool same_count = (size_t)stats.cells == grid.GetNumOrgs();
+  std::cout << comm.GetSize() << " processes, " << x << "x" << y << "x" << z << ", " << updates << " updates: "
+            << (size_t)stats.cells << " cells (grid engine " << grid.GetNumOrgs() << "); state "
+            << (same ? "matches" : "DIFFERS from") << " the grid engine" << std::endl;
+  return same && same_count ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+// Reads snapshot files written with SNAPSHOT_FILE.
+//
+//   snapshot_tool FILE                    list the grid, fields and frames
+//   snapshot_tool FILE FIELD UPDATE Z     print plane Z of FIELD at UPDATE as CSV
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../Snapshot.h"
+
+template <typename T, typename PRINT_T>
+bool PrintSlice(const snapshot::SnapshotReader & reader, size_t frame, size_t field, size_t z) {
+  std::vector<T> slice;
+  if (!reader.ReadSlice(frame, field, z, slice)) return false;
+  for (size_t y = 0; y < reader.GetYLen(); y++) {
+    for (size_t x = 0; x < reader.GetXLen(); x++) {
+      if (x) std::cout << ",";
+      std::cout << (PRINT_T)slice[y * reader.GetXLen() + x];
+    }
+    std::cout << "\n";
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2 && argc != 5) {
+    std::cerr << "Usage: " << argv[0] << " FILE [FIELD UPDATE Z]" << std::endl;
+    return 1;
+  }
+
+  snapshot::SnapshotReader reader;
+  if (!reader.Open(argv[1])) {
+    std::cerr << "Error: could not read snapshot file '" << argv[1] << "'" << std::endl;
+    return 1;
+  }
+
+  if (argc == 2) {
+    std::cout << "grid " << reader.GetXLen() << "x" << reader.GetYLen() << "x" << reader.GetZLen()
+              << ", " << reader.GetPlanesPerChunk() << " planes per chunk" << std::endl;
+    std::cout << "fields:";
+    for (const snapshot::FieldInfo & field : reader.GetFields()) {
+      std::cout << " " << field.name;
+    }
+    std::cout << std::endl << "updates:";
+    for (size_t i = 0; i < reader.GetNumFrames(); i++) {
+      std::cout << " " << reader.GetUpdate(i);
+    }
+    std::cout << std::endl;
+    return 0;
+  }
+
+  const int field = reader.GetFieldID(argv[2]);
+  const int frame = reader.GetFrameID((size_t)std::atol(argv[3]));
+  const size_t z = (size_t)std::atol(argv[4]);
+  if (field < 0 || frame < 0 || z >= reader.GetZLen()) {
+    std::cerr << "Error: no such field, update or plane" << std::endl;
+    return 1;
+  }
+
+  bool ok = false;
+  switch (reader.GetFields()[(size_t)field].type) {
+    case snapshot::U8: ok = PrintSlice<unsigned char, int>(reader, (size_t)frame, (size_t)field, z); break;
+    case snapshot::I32: ok = PrintSlice<int32_t, int32_t>(reader, (size_t)frame, (size_t)field, z); break;
+    case snapshot::F64: ok = PrintSlice<double, double>(reader, (size_t)frame, (size_t)field, z); break;
+  }
+  if (!ok) {
+    std::cerr << "Error: could not read plane " << z << " of '" << argv[2] << "'" << std::endl;
+    return 1;
+  }
+  return 0;
+}
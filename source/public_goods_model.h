@@ -1,7 +1,20 @@
 #ifndef _PublicGoods_MODEL_H
 #define _PublicGoods_MODEL_H
 
+#include <cstdlib>
+#include <fstream>
+#include <type_traits>
+
+#include "Checkpoint.h"
+#include "FieldSpec.h"
+#include "NeighborTable.h"
+#include "Logger.h"
+#include "ObjectPool.h"
+#include "OccupancyBitset.h"
+#include "Profiler.h"
 #include "ResourceGradient.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
 #include "config/ArgManager.h"
 #include "Evolve/World.h"
 #include "tools/spatial_stats.h"
@@ -15,20 +28,41 @@ EMP_BUILD_CONFIG( PublicGoodsConfig,
   VALUE(WORLD_Z, size_t, 50, "Depth of plate (in cells)"), 
   VALUE(INIT_POP_SIZE, int, 100, "Number of cells to seed population with"),
   VALUE(DATA_RESOLUTION, int, 10, "How many updates between printing data?"),
+  VALUE(POPULATION_FILE, std::string, "population.csv", "File for the population size every DATA_RESOLUTION updates (empty = none)"),
   VALUE(KM, double, 0.01, "Michaelis-Menten kinetic parameter"),
+  VALUE(NUM_THREADS, size_t, 1, "Threads used to update the public good (0 = all hardware threads)"),
+  VALUE(WORLD_ENGINE, std::string, "emp", "Cell storage: emp (emp::World, with signals and systematics), grid (flat per-voxel arrays) or slab (grid split along z over MPI processes; see source/HCASlabWorld.h)"),
+  VALUE(CHECKPOINT_INTERVAL, int, 0, "Updates between checkpoints (0 = never); restart with -restart FILE"),
+  VALUE(CHECKPOINT_FILE, std::string, "checkpoint.bin", "File each checkpoint replaces"),
+  VALUE(SNAPSHOT_FILE, std::string, "", "File to append the public good, cell and EXTRA_FIELDS grids to every DATA_RESOLUTION updates (empty = off)"),
+  VALUE(SNAPSHOT_CHUNK_PLANES, int, 4, "Z-planes per independently readable snapshot chunk"),
+  VALUE(VERBOSITY, int, 2, "Run output: 0 = none, 1 = config and summary, 2 = also progress with rate and ETA, 3 = every update"),
+  VALUE(PROGRESS_INTERVAL, double, 1.0, "Minimum seconds between progress lines (VERBOSITY 2)"),
+  VALUE(PROFILE_TRACE_FILE, std::string, "", "Chrome trace-event JSON of every phase, written at exit (needs a build with PROFILE=1)"),
+  VALUE(SNAPSHOT_COMPRESS, bool, false, "Compress snapshot chunks with zstd (needs a build with USE_ZSTD=1)"),
   
   GROUP(CELL, "Cell settings"),
   VALUE(MITOSIS_PROB, double, .5, "Probability of mitosis"),
   VALUE(AGE_LIMIT, int, 100, "Age over which non-stem cells die"),
   VALUE(RESISTANCE_MUT_STDEV, double, .01, "Standard deviation of gaussian controlling resistance mutation"),
+  VALUE(PARALLEL_CELL_UPDATE, bool, false, "Update cells on NUM_THREADS threads with a per-voxel random stream (grid engine only; same results for any thread count, but not the same as the serial update)"),
 
   GROUP(PUBLIC_GOOD, "Public good settings"),
   VALUE(INITIAL_PUBLIC_GOOD_LEVEL, double, 0, "Initial quantity of public good (will be placed in all cells)"),
   VALUE(PUBLIC_GOOD_PRODUCTION_RATE, double, .1, "Public good produced per time step"),
   VALUE(PUBLIC_GOOD_DIFFUSION_COEFFICIENT, double, .1, "Public good diffusion coefficient"),
   VALUE(DIFFUSION_STEPS_PER_TIME_STEP, int, 10, "Rate at which diffusion is calculated relative to rest of model"),
+  VALUE(DIFFUSION_SOLVER, std::string, "explicit", "explicit (stable for coefficient <= 1/6) or adi (one unconditionally stable implicit step per update)"),
+  VALUE(TEMPORAL_BLOCK_STEPS, int, 1, "Diffusion steps advanced per sweep over the grid (1 = no temporal blocking; needs FUSED_PUBLIC_GOOD_UPDATE)"),
   VALUE(BASAL_PUBLIC_GOOD_CONSUMPTION, double, .1, "Rate at which public goods are consumed"),
   VALUE(BASAL_PUBLIC_GOOD_DECAY, double, .01, "Rate at which public goods decay out of the environment"),
+  VALUE(FUSED_PUBLIC_GOOD_UPDATE, bool, true, "Update the public good in one fused pass (false = original multi-pass path, for validation)"),
+  VALUE(ACTIVE_REGION, bool, false, "Only update rows of the grid the public good has reached (fused explicit path; disables temporal blocking)"),
+  VALUE(ACTIVE_REGION_EPSILON, double, 0, "With ACTIVE_REGION, rows of public good below this level are zeroed and skipped (0 = only skip exact zeros, matching a full update exactly)"),
+  VALUE(STEADY_STATE, bool, false, "Freeze rows of the grid whose fields have settled until a cell nearby is born or dies (fused explicit path; replaces ACTIVE_REGION, disables temporal blocking)"),
+  VALUE(STEADY_STATE_EPSILON, double, 0, "With STEADY_STATE, rows changing by at most this per diffusion step count as settled (0 = only rows that do not change at all, matching a full update exactly)"),
+  VALUE(PUBLIC_GOOD_PRECISION, std::string, "double", "Scalar type of the public good field: double or float (half the memory and twice the vector width, less accurate)"),
+  VALUE(PUBLIC_GOOD_COMPENSATED, bool, false, "Compensated summation in the explicit diffusion stencil, limiting rounding drift with float precision (slower; not bit-identical to the plain sum)"),
   VALUE(PRODUCER_RELATIVE_FITNESS, double, .5, "Mitosis probability of producers relative to that of consumers (MITOSIS_PROB)"),
 
   // VALUE(PUBLIC_GOOD_THRESHOLD, double, .1, "How much public_good do cells need to survive?"),
@@ -36,6 +70,9 @@ EMP_BUILD_CONFIG( PublicGoodsConfig,
   GROUP(DRUG, "Drug settings"),
   VALUE(DRUG_CONCENTRATION, double, .1, "Quantity of drug in environment"),
 
+  GROUP(FIELDS, "Further diffusing fields"),
+  VALUE(EXTRA_FIELDS, std::string, "", "Fields besides the public good, as name:effect:diffusion:decay:production:consumption:supply:initial entries separated by ';' (see source/FieldSpec.h; empty = none)"),
+
 );
 
 struct Cell {
@@ -54,9 +91,31 @@ struct Cell {
       return age*resistance < other.age*other.resistance;
     }
 
+#ifndef NO_CELL_POOL
+    // emp::World allocates a new Cell for every surviving cell on every
+    // update and deletes the old one, so recycle their storage instead of
+    // going through malloc. A cell may be deleted on a different thread
+    // from the one that created it; its storage goes back to the creating
+    // thread's pool. Define NO_CELL_POOL to use the global heap (e.g. when
+    // hunting memory errors with a sanitizer).
+    static void * operator new(size_t size) {
+      if (size != sizeof(Cell)) return ::operator new(size);
+      HCA_PROFILE_COUNT(CELL_ALLOCATIONS);
+      return ObjectPool<Cell>::Local().Allocate();
+    }
+
+    static void operator delete(void * ptr, size_t size) {
+      if (size != sizeof(Cell)) return ::operator delete(ptr);
+      ObjectPool<Cell>::Release(ptr);
+    }
+#endif
+
 };
 
-class HCAWorld : public emp::World<Cell> {
+/// Parameters and public good dynamics shared by the world engines. The
+/// engines differ only in how they store cells; they describe the
+/// population to the public good code through occupied_mask/producer_mask.
+class HCAModelBase {
   protected:
   int TIME_STEPS;
   double PUBLIC_GOOD_DIFFUSION_COEFFICIENT;
@@ -72,23 +131,273 @@ class HCAWorld : public emp::World<Cell> {
   double DRUG_CONCENTRATION;
   double PRODUCER_RELATIVE_FITNESS;
   double PUBLIC_GOOD_PRODUCTION_RATE;
+  bool FUSED_PUBLIC_GOOD_UPDATE;
+  int TEMPORAL_BLOCK_STEPS;
+  bool IMPLICIT_DIFFUSION; // DIFFUSION_SOLVER == "adi"
+  bool PARALLEL_CELL_UPDATE;
+  bool ACTIVE_REGION;
+  double ACTIVE_REGION_EPSILON;
+  bool STEADY_STATE;
+  double STEADY_STATE_EPSILON;
+  int CHECKPOINT_INTERVAL;
+  std::string CHECKPOINT_FILE;
+  int DATA_RESOLUTION;
+  std::string POPULATION_FILE;
+  std::string SNAPSHOT_FILE;
+  std::string PROFILE_TRACE_FILE;
+  int SNAPSHOT_CHUNK_PLANES;
+  bool SNAPSHOT_COMPRESS;
+  bool FLOAT_PUBLIC_GOOD; // PUBLIC_GOOD_PRECISION == "float"
+  bool PUBLIC_GOOD_COMPENSATED;
+  emp::vector<FieldSpec> extra_fields; // EXTRA_FIELDS; field f + 1 of the public good grid
 
   size_t WORLD_X;
   size_t WORLD_Y;
   size_t WORLD_Z;
 
-  public:
-  emp::Ptr<ResourceGradient> public_good;
-
-  HCAWorld(emp::Random & r) : emp::World<Cell>(r), public_good(nullptr) {;}
-  HCAWorld() {;}
+  ThreadPool thread_pool;
+  NeighborTable neighbors; // Candidate division targets of each voxel
+
+  // Per-voxel view of the population that the public good phases read, so
+  // that worker threads never need to touch the engine's own cell storage.
+  // Kept up to date by RefreshCellMasks().
+  emp::vector<unsigned char> occupied_mask;
+  emp::vector<unsigned char> producer_mask; // occupied and a producer
+
+  // Occupied voxels of the current generation. Unlike the masks this is
+  // maintained by the engines as cells are placed, so it is always current.
+  OccupancyBitset occupied_bits;
+
+  // Rows (see ResourceGradient::GetNumRows) holding at least one producer,
+  // used with ACTIVE_REGION
+  emp::vector<unsigned char> producer_rows;
+
+  bool show_progress = true; // Report progress through the Logger
+  CheckpointWriter checkpoint_writer;
+  snapshot::SnapshotWriter snapshot_writer;
+  std::ofstream population_out; // POPULATION_FILE, once its first row is due
+  size_t resume_update = (size_t)-1; // Update the run was restarted from, if it was
+
+  /// Bring occupied_mask/producer_mask up to date with the population
+  virtual void RefreshCellMasks() = 0;
+
+  /// Create the public good field at the configured precision
+  void NewPublicGood() {
+    DeletePublicGood();
+    const size_t num_fields = 1 + extra_fields.size();
+    if (FLOAT_PUBLIC_GOOD) {
+      public_good_float.New(WORLD_X, WORLD_Y, WORLD_Z, num_fields);
+    } else {
+      public_good.New(WORLD_X, WORLD_Y, WORLD_Z, num_fields);
+    }
+    WithPublicGood([this](auto & grad){
+      grad.SetDiffusionCoefficient(PUBLIC_GOOD_DIFFUSION_COEFFICIENT);
+      grad.SetCompensated(PUBLIC_GOOD_COMPENSATED);
+      for (size_t f = 0; f < extra_fields.size(); f++) {
+        grad.SetFieldDiffusionCoefficient(f + 1, extra_fields[f].diffusion);
+      }
+    });
+  }
 
-  ~HCAWorld() {
+  void DeletePublicGood() {
     if (public_good) {
       public_good.Delete();
+      public_good = nullptr;
+    }
+    if (public_good_float) {
+      public_good_float.Delete();
+      public_good_float = nullptr;
+    }
+  }
+
+  /// Copy the public good grids into @param cp (already sized), along
+  /// with those of the extra fields and the STEADY_STATE row state.
+  /// Checkpoints always hold doubles, whatever the precision of the run.
+  void SaveField(Checkpoint & cp) const {
+    cp.ResizeExtraFields(extra_fields.size());
+    WithPublicGood([this, &cp](const auto & grad){
+      for (size_t f = 0; f <= extra_fields.size(); f++) {
+        double * curr = f ? cp.extra_curr_field.data() + (f - 1) * cp.GetSize() : cp.curr_field.data();
+        double * next = f ? cp.extra_next_field.data() + (f - 1) * cp.GetSize() : cp.next_field.data();
+        for (size_t r = 0; r < WORLD_Y * WORLD_Z; r++) {
+          const size_t offset = grad.FieldIndex(f, 0, r % WORLD_Y, r / WORLD_Y);
+          std::copy(grad.GetCurrData() + offset, grad.GetCurrData() + offset + WORLD_X, curr + r * WORLD_X);
+          std::copy(grad.GetNextData() + offset, grad.GetNextData() + offset + WORLD_X, next + r * WORLD_X);
+        }
+      }
+      if (grad.IsTrackingSteadyRows()) {
+        grad.SaveSteadyRows(cp.steady_rows, cp.steady_cells);
+      }
+    });
+  }
+
+  /// Restore the grids from @param cp. The STEADY_STATE row state is
+  /// restored with them when the checkpoint has it; otherwise every row
+  /// starts out awake, which only gives the same results as the original
+  /// run with STEADY_STATE_EPSILON 0.
+  void LoadField(const Checkpoint & cp) {
+    bool steady_restored = false;
+    WithPublicGood([this, &cp, &steady_restored](auto & grad){
+      for (size_t f = 0; f <= extra_fields.size(); f++) {
+        const double * curr = f ? cp.extra_curr_field.data() + (f - 1) * cp.GetSize() : cp.curr_field.data();
+        const double * next = f ? cp.extra_next_field.data() + (f - 1) * cp.GetSize() : cp.next_field.data();
+        for (size_t r = 0; r < WORLD_Y * WORLD_Z; r++) {
+          const size_t offset = grad.FieldIndex(f, 0, r % WORLD_Y, r / WORLD_Y);
+          std::copy(curr + r * WORLD_X, curr + (r + 1) * WORLD_X, grad.GetCurrData() + offset);
+          std::copy(next + r * WORLD_X, next + (r + 1) * WORLD_X, grad.GetNextData() + offset);
+        }
+      }
+      if (STEADY_STATE && !cp.steady_rows.empty()) {
+        steady_restored = grad.LoadSteadyRows(STEADY_STATE_EPSILON, cp.steady_rows, cp.steady_cells);
+      }
+    });
+    if (!steady_restored) RetrackPublicGood();
+  }
+
+  /// Let the row tracking of ACTIVE_REGION and STEADY_STATE know that the
+  /// public good grids have been written to directly
+  void RetrackPublicGood() {
+    WithPublicGood([this](auto & grad){
+      if (grad.IsTrackingActiveRows()) {
+        grad.TrackActiveRows(ACTIVE_REGION_EPSILON);
+      }
+      if (grad.IsTrackingSteadyRows()) {
+        grad.TrackSteadyRows(STEADY_STATE_EPSILON);
+      }
+    });
+  }
+
+  static void SaveRandom(const emp::Random & random, Checkpoint & cp) {
+    static_assert(std::is_trivially_copyable<emp::Random>::value, "checkpoints copy emp::Random bytewise");
+    cp.random_state.resize(sizeof(emp::Random));
+    std::memcpy(cp.random_state.data(), &random, sizeof(emp::Random));
+  }
+
+  static bool LoadRandom(emp::Random & random, const Checkpoint & cp) {
+    if (cp.random_state.size() != sizeof(emp::Random)) return false;
+    std::memcpy(&random, cp.random_state.data(), sizeof(emp::Random));
+    return true;
+  }
+
+  /// Read @param filename into @param cp, checking that it belongs to a
+  /// grid of this size
+  bool ReadCheckpoint(const std::string & filename, Checkpoint & cp) {
+    if (!cp.Read(filename)) {
+      std::cerr << "Error: could not read checkpoint '" << filename << "'" << std::endl;
+      return false;
+    }
+    if (cp.x_len != WORLD_X || cp.y_len != WORLD_Y || cp.z_len != WORLD_Z) {
+      std::cerr << "Error: checkpoint '" << filename << "' is for a " << cp.x_len << "x" << cp.y_len
+                << "x" << cp.z_len << " world" << std::endl;
+      return false;
+    }
+    if (cp.extra_fields != extra_fields.size()) {
+      std::cerr << "Error: checkpoint '" << filename << "' has " << cp.extra_fields
+                << " extra fields, but EXTRA_FIELDS lists " << extra_fields.size() << std::endl;
+      return false;
+    }
+    resume_update = cp.update;
+    return true;
+  }
+
+  /// Whole state of the run, for a checkpoint
+  virtual Checkpoint GetCheckpoint() = 0;
+
+  /// Hand a checkpoint to the background writer if one is due after
+  /// @param update updates
+  void CheckpointIfDue(size_t update) {
+    if (CHECKPOINT_INTERVAL > 0 && update % (size_t)CHECKPOINT_INTERVAL == 0) {
+      HCA_PROFILE_SCOPE(OUTPUT);
+      checkpoint_writer.Submit(GetCheckpoint(), CHECKPOINT_FILE);
+    }
+  }
+
+  /// Add the row for @param update, with @param num_orgs living cells, to
+  /// POPULATION_FILE if one is due. The file is opened on the first row;
+  /// after a restart, the rows from the restarted update on are replaced
+  /// and those before it kept.
+  void PopulationIfDue(size_t update, size_t num_orgs) {
+    if (POPULATION_FILE.empty() || DATA_RESOLUTION <= 0 || update % (size_t)DATA_RESOLUTION != 0) {
+      return;
+    }
+    if (!population_out.is_open()) {
+      std::string rows = "update,num_orgs\n";
+      if (resume_update != (size_t)-1) {
+        std::ifstream in(POPULATION_FILE);
+        std::string line;
+        std::getline(in, line); // Header
+        while (std::getline(in, line) && std::strtoull(line.c_str(), nullptr, 10) < resume_update) {
+          rows += line + "\n";
+        }
+      }
+      population_out.open(POPULATION_FILE, std::ios::trunc);
+      population_out << rows;
+    }
+    population_out << update << "," << num_orgs << "\n";
+    population_out.flush();
+    if (!population_out) {
+      std::cerr << "Warning: could not write population file '" << POPULATION_FILE << "'; no further rows will be written"
+                << std::endl;
+      POPULATION_FILE.clear();
     }
   }
 
+  /// Hand the grids to the snapshot writer if a frame is due after
+  /// @param update updates. The file is opened on the first frame; after
+  /// a restart, frames written after the restarted update are replaced.
+  /// Snapshots stop once the writer has failed to write a frame.
+  void SnapshotIfDue(size_t update) {
+    if (SNAPSHOT_FILE.empty() || DATA_RESOLUTION <= 0 || update % (size_t)DATA_RESOLUTION != 0) {
+      return;
+    }
+    if (snapshot_writer.HasFailed()) {
+      SNAPSHOT_FILE.clear();
+      return;
+    }
+    if (!snapshot_writer.IsOpen()) {
+      emp::vector<std::string> extra_field_names;
+      for (const FieldSpec & field : extra_fields) {
+        extra_field_names.push_back(field.name);
+      }
+      if (!snapshot_writer.Open(SNAPSHOT_FILE, WORLD_X, WORLD_Y, WORLD_Z, (size_t)std::max(SNAPSHOT_CHUNK_PLANES, 1),
+                                SNAPSHOT_COMPRESS, extra_field_names, resume_update)) {
+        std::cerr << "Warning: could not open snapshot file '" << SNAPSHOT_FILE << "'; snapshots disabled" << std::endl;
+        SNAPSHOT_FILE.clear();
+        return;
+      }
+    }
+    HCA_PROFILE_SCOPE(OUTPUT);
+    snapshot_writer.Submit(update, GetCheckpoint());
+  }
+
+  /// Log the profile of the last DATA_RESOLUTION updates if @param update
+  /// ends such an interval (only in builds with HCA_PROFILE)
+  void ProfileIfDue(size_t update) {
+    if (Profiler::ENABLED && DATA_RESOLUTION > 0 && update % (size_t)DATA_RESOLUTION == 0) {
+      Profiler::Get().ReportInterval(update);
+    }
+  }
+
+  /// Log the profile of the whole run and write the trace, if any
+  void FinishProfile() {
+    if (!Profiler::ENABLED) return;
+    Profiler::Get().ReportTotals();
+    if (!Profiler::Get().WriteTrace()) {
+      std::cerr << "Warning: could not write profile trace '" << PROFILE_TRACE_FILE << "'" << std::endl;
+    }
+  }
+
+  public:
+  // The public good field; only the one for PUBLIC_GOOD_PRECISION exists
+  emp::Ptr<ResourceGradient> public_good;
+  emp::Ptr<BasicResourceGradient<float>> public_good_float;
+
+  HCAModelBase() : public_good(nullptr), public_good_float(nullptr) {;}
+
+  virtual ~HCAModelBase() {
+    DeletePublicGood();
+  }
+
   void InitConfigs(PublicGoodsConfig & config) {
     TIME_STEPS = config.TIME_STEPS();
     MITOSIS_PROB = config.MITOSIS_PROB();
@@ -105,14 +414,67 @@ class HCAWorld : public emp::World<Cell> {
     DRUG_CONCENTRATION = config.DRUG_CONCENTRATION();
     PRODUCER_RELATIVE_FITNESS = config.PRODUCER_RELATIVE_FITNESS();
     PUBLIC_GOOD_PRODUCTION_RATE = config.PUBLIC_GOOD_PRODUCTION_RATE();
+    FUSED_PUBLIC_GOOD_UPDATE = config.FUSED_PUBLIC_GOOD_UPDATE();
+    TEMPORAL_BLOCK_STEPS = config.TEMPORAL_BLOCK_STEPS();
+    PARALLEL_CELL_UPDATE = config.PARALLEL_CELL_UPDATE();
+    ACTIVE_REGION = config.ACTIVE_REGION();
+    ACTIVE_REGION_EPSILON = config.ACTIVE_REGION_EPSILON();
+    STEADY_STATE = config.STEADY_STATE();
+    STEADY_STATE_EPSILON = config.STEADY_STATE_EPSILON();
+    if (STEADY_STATE && ACTIVE_REGION) {
+      // Rows that stay zero are settled rows too
+      std::cerr << "Warning: STEADY_STATE replaces ACTIVE_REGION; ignoring ACTIVE_REGION" << std::endl;
+      ACTIVE_REGION = false;
+    }
+    CHECKPOINT_INTERVAL = config.CHECKPOINT_INTERVAL();
+    CHECKPOINT_FILE = config.CHECKPOINT_FILE();
+    DATA_RESOLUTION = config.DATA_RESOLUTION();
+    POPULATION_FILE = config.POPULATION_FILE();
+    population_out.close();
+    SNAPSHOT_FILE = config.SNAPSHOT_FILE();
+    SNAPSHOT_CHUNK_PLANES = config.SNAPSHOT_CHUNK_PLANES();
+    SNAPSHOT_COMPRESS = config.SNAPSHOT_COMPRESS();
+    FLOAT_PUBLIC_GOOD = config.PUBLIC_GOOD_PRECISION() == "float";
+    if (!FLOAT_PUBLIC_GOOD && config.PUBLIC_GOOD_PRECISION() != "double") {
+      std::cerr << "Warning: unknown PUBLIC_GOOD_PRECISION '" << config.PUBLIC_GOOD_PRECISION()
+                << "'; using double" << std::endl;
+    }
+    PUBLIC_GOOD_COMPENSATED = config.PUBLIC_GOOD_COMPENSATED();
+    IMPLICIT_DIFFUSION = config.DIFFUSION_SOLVER() == "adi";
+    if (!IMPLICIT_DIFFUSION && config.DIFFUSION_SOLVER() != "explicit") {
+      std::cerr << "Warning: unknown DIFFUSION_SOLVER '" << config.DIFFUSION_SOLVER()
+                << "'; using explicit" << std::endl;
+    }
+    std::string field_error;
+    if (!FieldSpec::ParseList(config.EXTRA_FIELDS(), extra_fields, field_error)) {
+      std::cerr << "Warning: could not parse EXTRA_FIELDS (" << field_error << "); running without them" << std::endl;
+      extra_fields.clear();
+    }
+    if (!extra_fields.empty() && (IMPLICIT_DIFFUSION || !FUSED_PUBLIC_GOOD_UPDATE || TEMPORAL_BLOCK_STEPS > 1 || ACTIVE_REGION)) {
+      // Only the fused explicit update knows about the extra fields
+      std::cerr << "Warning: EXTRA_FIELDS need the fused explicit update; ignoring DIFFUSION_SOLVER, "
+                << "FUSED_PUBLIC_GOOD_UPDATE, TEMPORAL_BLOCK_STEPS and ACTIVE_REGION" << std::endl;
+      IMPLICIT_DIFFUSION = false;
+      FUSED_PUBLIC_GOOD_UPDATE = true;
+      TEMPORAL_BLOCK_STEPS = 1;
+      ACTIVE_REGION = false;
+    }
 
     WORLD_X = config.WORLD_X();
     WORLD_Y = config.WORLD_Y();
     WORLD_Z = config.WORLD_Z();
 
-    if (public_good) {
-      public_good->SetDiffusionCoefficient(PUBLIC_GOOD_DIFFUSION_COEFFICIENT);
+    thread_pool.SetNumThreads(config.NUM_THREADS());
+    PROFILE_TRACE_FILE = config.PROFILE_TRACE_FILE();
+    if (!Profiler::ENABLED && PROFILE_TRACE_FILE != "") {
+      std::cerr << "Warning: PROFILE_TRACE_FILE needs a build with PROFILE=1 (HCA_PROFILE); no trace written" << std::endl;
     }
+    Profiler::Get().SetTraceFile(PROFILE_TRACE_FILE);
+    neighbors.Setup(WORLD_X, WORLD_Y, WORLD_Z);
+
+    WithPublicGood([this](auto & grad){
+      grad.SetDiffusionCoefficient(PUBLIC_GOOD_DIFFUSION_COEFFICIENT);
+    });
   }
 
   size_t GetWorldX() {
@@ -128,69 +490,355 @@ class HCAWorld : public emp::World<Cell> {
   }
 
 
-  void InitPop() {
-    for (size_t cell_id = 0; cell_id < (size_t)INIT_POP_SIZE; cell_id++) {
-      Inject(Cell(0, random_ptr->P(.5)));
-    }
-  }
-
   void InitPublicGood() {
-    for (size_t x = 0; x < WORLD_X; x++) {
-      for (size_t y = 0; y < WORLD_Y; y++) {
-        for (size_t z = 0; z < WORLD_Z; z++) {
-          public_good->SetVal(x, y, z, INITIAL_PUBLIC_GOOD_LEVEL);
+    WithPublicGood([this](auto & grad){
+      for (size_t x = 0; x < WORLD_X; x++) {
+        for (size_t y = 0; y < WORLD_Y; y++) {
+          for (size_t z = 0; z < WORLD_Z; z++) {
+            grad.SetVal(x, y, z, INITIAL_PUBLIC_GOOD_LEVEL);
+            for (size_t f = 0; f < extra_fields.size(); f++) {
+              grad.SetFieldVal(f + 1, x, y, z, extra_fields[f].initial);
+            }
+          }
         }
       }
-    }
+    });
+  }
+
+  /// Turn per-update progress output on or off (sweeps run many worlds
+  /// against the one log and report progress themselves)
+  void SetShowProgress(bool show) {
+    show_progress = show;
   }
 
+  /// The public good field of a double precision run
   ResourceGradient& GetPublicGood() {
+    emp_assert(public_good, "GetPublicGood() needs PUBLIC_GOOD_PRECISION double; use WithPublicGood()");
     return *public_good;
   }
 
+  /// Call @param fn with the public good field, whichever its precision
+  template <typename FN>
+  void WithPublicGood(FN && fn) {
+    if (public_good_float) fn(*public_good_float);
+    else if (public_good) fn(*public_good);
+  }
+
+  template <typename FN>
+  void WithPublicGood(FN && fn) const {
+    if (public_good_float) fn(static_cast<const BasicResourceGradient<float> &>(*public_good_float));
+    else if (public_good) fn(static_cast<const ResourceGradient &>(*public_good));
+  }
+
+  /// Public good at (@param x, @param y, @param z)
+  double GetPublicGoodVal(size_t x, size_t y, size_t z = 0) const {
+    return public_good_float ? public_good_float->GetVal(x, y, z) : public_good->GetVal(x, y, z);
+  }
+
+  /// Public good in the voxel of @param cell_id
+  double GetCellPublicGood(size_t cell_id) const {
+    return public_good_float ? public_good_float->GetCellVal(cell_id) : public_good->GetCellVal(cell_id);
+  }
+
+  /// Number of EXTRA_FIELDS
+  size_t GetNumExtraFields() const {return extra_fields.size();}
+
+  /// Value of extra field @param field (0-based, in EXTRA_FIELDS order) at
+  /// (@param x, @param y, @param z)
+  double GetExtraFieldVal(size_t field, size_t x, size_t y, size_t z = 0) const {
+    return public_good_float ? public_good_float->GetFieldVal(field + 1, x, y, z)
+                             : public_good->GetFieldVal(field + 1, x, y, z);
+  }
+
+  /// What the extra fields add to the death probability of the cell in
+  /// the voxel of @param cell_id
+  double GetCellFieldEffect(size_t cell_id) const {
+    double effect = 0;
+    WithPublicGood([this, cell_id, &effect](const auto & grad){
+      for (size_t f = 0; f < extra_fields.size(); f++) {
+        effect += extra_fields[f].effect * grad.GetCellFieldVal(f + 1, cell_id);
+      }
+    });
+    return effect;
+  }
+
+  /// Run @param fn(row_begin, row_end) over the whole grid, split into one
+  /// contiguous slab of (y, z) rows per thread. Every phase that uses this
+  /// only writes to voxels inside its own slab, so results do not depend
+  /// on the number of threads.
+  void ForEachSlab(const ThreadPool::range_fun_t & fn) {
+    thread_pool.ParallelFor(0, WORLD_Y * WORLD_Z, fn);
+  }
+
   void UpdatePublicGood() {
-      BasalPublicGoodConsumption();
-      public_good->Diffuse();
-      public_good->Update();
+    if (IMPLICIT_DIFFUSION) {
+      UpdatePublicGoodImplicit(1);
+    } else if (FUSED_PUBLIC_GOOD_UPDATE) {
+      UpdatePublicGoodFused();
+    } else {
+      UpdatePublicGoodMultiPass();
+    }
+  }
+
+  /// Run @param steps consecutive public good updates, as the model does
+  /// between two RunStep() calls. With TEMPORAL_BLOCK_STEPS > 1 these are
+  /// advanced TEMPORAL_BLOCK_STEPS at a time per sweep over the grid.
+  void UpdatePublicGood(int steps) {
+    HCA_PROFILE_SCOPE(PUBLIC_GOOD);
+    if (IMPLICIT_DIFFUSION) {
+      if (steps > 0) UpdatePublicGoodImplicit((size_t)steps);
+      return;
+    }
+
+    bool toroidal = false;
+    WithPublicGood([&toroidal](const auto & grad){ toroidal = grad.GetToroidal(); });
+    const bool blocked = FUSED_PUBLIC_GOOD_UPDATE && TEMPORAL_BLOCK_STEPS > 1 && !toroidal && !ACTIVE_REGION && !STEADY_STATE;
+    while (steps > 0) {
+      if (blocked && steps > 1) {
+        const int block = std::min(steps, TEMPORAL_BLOCK_STEPS);
+        UpdatePublicGoodBlocked((size_t)block);
+        steps -= block;
+      } else {
+        UpdatePublicGood();
+        steps--;
+      }
+    }
+  }
+
+  stencil::SourceTerms GetSourceTerms() {
+    {
+      HCA_PROFILE_SCOPE(CELL_MASKS);
+      RefreshCellMasks();
+    }
+
+    stencil::SourceTerms src;
+    src.occupied = occupied_mask.data();
+    src.producer = producer_mask.data();
+    src.km = KM;
+    src.consumption = BASAL_PUBLIC_GOOD_CONSUMPTION;
+    src.production = PUBLIC_GOOD_PRODUCTION_RATE;
+    src.decay = BASAL_PUBLIC_GOOD_DECAY;
+    return src;
+  }
+
+  /// Same result as UpdatePublicGoodMultiPass(), but each voxel's
+  /// consumption, diffusion, clamping, production and decay happen in one
+  /// streaming pass over the grid. With EXTRA_FIELDS, that same pass
+  /// updates all of the fields. With STEADY_STATE it skips the rows that
+  /// have settled.
+  void UpdatePublicGoodFused() {
+    const stencil::SourceTerms src = GetSourceTerms();
+    emp::vector<stencil::SourceTerms> field_src(1, src);
+    for (const FieldSpec & spec : extra_fields) {
+      stencil::SourceTerms extra = src;
+      extra.consumption = spec.consumption;
+      extra.production = spec.production;
+      extra.decay = spec.decay;
+      extra.supply = spec.supply;
+      field_src.push_back(extra);
+    }
+
+    WithPublicGood([&](auto & grad){
+      grad.PrepareFusedUpdate();
+      HCA_PROFILE_SCOPE(DIFFUSION);
+      if (STEADY_STATE) {
+        if (!grad.IsTrackingSteadyRows()) {
+          grad.TrackSteadyRows(STEADY_STATE_EPSILON);
+        }
+        const stencil::SourceTerms * srcs = field_src.data();
+        ForEachSlab([&grad, srcs](size_t row_begin, size_t row_end){
+          grad.FusedUpdateSteady(srcs, row_begin, row_end);
+        });
+      } else if (!extra_fields.empty()) {
+        const stencil::SourceTerms * srcs = field_src.data();
+        ForEachSlab([&grad, srcs](size_t row_begin, size_t row_end){
+          grad.FusedUpdateFields(srcs, row_begin, row_end);
+        });
+      } else if (ACTIVE_REGION) {
+        if (!grad.IsTrackingActiveRows()) {
+          grad.TrackActiveRows(ACTIVE_REGION_EPSILON);
+        }
+        RefreshProducerRows();
+        const unsigned char * rows = producer_rows.data();
+        ForEachSlab([&grad, &src, rows](size_t row_begin, size_t row_end){
+          grad.FusedUpdateActive(src, rows, row_begin, row_end);
+        });
+      } else {
+        ForEachSlab([&grad, &src](size_t row_begin, size_t row_end){
+          grad.FusedUpdate(src, row_begin, row_end);
+        });
+      }
+      grad.FinishFusedUpdate();
+    });
+  }
 
-      for (size_t cell_id = 0; cell_id < GetSize(); cell_id++) {
-        size_t x = cell_id % WORLD_X;
-        size_t y = (cell_id / WORLD_X) % WORLD_Y;
-        size_t z = (cell_id / WORLD_X) / WORLD_Y;
+  /// Recompute producer_rows from the current population (needs the masks
+  /// to be up to date)
+  void RefreshProducerRows() {
+    producer_rows.assign(WORLD_Y * WORLD_Z, 0);
+    occupied_bits.ForEachSet(0, occupied_bits.size(), [this](size_t cell_id){
+      if (producer_mask[cell_id]) {
+        producer_rows[cell_id / WORLD_X] = 1;
+      }
+    });
+  }
+
+  /// Same result as @param steps calls to UpdatePublicGoodFused(), with a
+  /// single pass over main memory (see stencil::BlockedUpdate).
+  void UpdatePublicGoodBlocked(size_t steps) {
+    const stencil::SourceTerms src = GetSourceTerms();
+    WithPublicGood([&](auto & grad){
+      grad.PrepareFusedUpdate();
+      {
+        HCA_PROFILE_SCOPE(DIFFUSION);
+        ForEachSlab([&grad, &src, steps](size_t row_begin, size_t row_end){
+          grad.BlockedUpdate(src, steps, row_begin, row_end);
+        });
+      }
+      {
+        HCA_PROFILE_SCOPE(SOURCES);
+        ForEachSlab([&grad, &src](size_t row_begin, size_t row_end){
+          grad.ResetSources(src, row_begin, row_end);
+        });
+      }
+      grad.FinishFusedUpdate();
+    });
+  }
+
+  /// Advance the public good by @param steps explicit steps' worth of time
+  /// with a single backward-Euler step, split into implicit solves along
+  /// x, y and z (alternating-direction / locally one-dimensional scheme).
+  /// Unlike the explicit update this is stable for any diffusion
+  /// coefficient, so fast-diffusing goods need no extra substeps. It is
+  /// first-order accurate in time and so close to, but not bit-identical
+  /// with, the explicit path.
+  void UpdatePublicGoodImplicit(size_t steps) {
+    const stencil::SourceTerms src = GetSourceTerms();
+    WithPublicGood([&](auto & grad){
+      grad.SetupImplicit(steps);
+      HCA_PROFILE_SCOPE(DIFFUSION);
+      ForEachSlab([&grad, &src, steps](size_t row_begin, size_t row_end){
+        grad.AddImplicitSources(src, steps, row_begin, row_end);
+        grad.SolveImplicitX(row_begin, row_end);
+      });
+      thread_pool.ParallelFor(0, WORLD_Z, [&grad](size_t z_begin, size_t z_end){
+        grad.SolveImplicitY(z_begin, z_end);
+      });
+      thread_pool.ParallelFor(0, WORLD_Y, [&grad](size_t y_begin, size_t y_end){
+        grad.SolveImplicitZ(y_begin, y_end);
+      });
+    });
+  }
+
+  void UpdatePublicGoodMultiPass() {
+      {
+        HCA_PROFILE_SCOPE(CELL_MASKS);
+        RefreshCellMasks();
+      }
+      BasalPublicGoodConsumption();
 
-        if (IsOccupied(cell_id) && GetOrg(cell_id).producer) {
-          public_good->IncNextVal(x, y, z, PUBLIC_GOOD_PRODUCTION_RATE);
+      WithPublicGood([&](auto & grad){
+        {
+          HCA_PROFILE_SCOPE(DIFFUSION);
+          ForEachSlab([&grad](size_t row_begin, size_t row_end){
+            grad.Diffuse(row_begin, row_end);
+          });
         }
-        public_good->DecNextVal(x, y, z, BASAL_PUBLIC_GOOD_DECAY);
+
+        HCA_PROFILE_SCOPE(SOURCES);
+        grad.SwapGrids();
+        ForEachSlab([&grad](size_t row_begin, size_t row_end){
+          grad.ResetRows(row_begin, row_end);
+        });
+
+        const unsigned char * producer = producer_mask.data();
+        ForEachSlab([this, &grad, producer](size_t row_begin, size_t row_end){
+          for (size_t cell_id = row_begin * WORLD_X; cell_id < row_end * WORLD_X; cell_id++) {
+            if (producer[cell_id]) {
+              grad.IncNextCellVal(cell_id, PUBLIC_GOOD_PRODUCTION_RATE);
+            }
+            grad.DecNextCellVal(cell_id, BASAL_PUBLIC_GOOD_DECAY);
+          }
+        });
+      });
+  }
+
+  void BasalPublicGoodConsumption() {
+    HCA_PROFILE_SCOPE(CONSUMPTION);
+    WithPublicGood([&](auto & grad){
+      ForEachSlab([this, &grad](size_t row_begin, size_t row_end){
+        occupied_bits.ForEachSet(row_begin * WORLD_X, row_end * WORLD_X, [this, &grad](size_t cell_id){
+          double public_good_loss_multiplier = grad.GetCellVal(cell_id);
+          public_good_loss_multiplier /= public_good_loss_multiplier + KM;
+          grad.DecNextCellVal(cell_id, BASAL_PUBLIC_GOOD_CONSUMPTION * public_good_loss_multiplier);
+          // std::cout << "Decrementing: " << BASAL_PUBLIC_GOOD_CONSUMPTION * public_good_loss_multiplier << std::endl;
+        });
+      });
+    });
+  }
+};
+
+class HCAWorld : public emp::World<Cell>, public HCAModelBase {
+  protected:
+  size_t mask_update = (size_t)-1;
+  OccupancyBitset next_bits; // Occupied voxels of the generation being built
+
+  public:
+  HCAWorld(emp::Random & r) : emp::World<Cell>(r) {;}
+  HCAWorld() {;}
+
+  void InitPop() {
+    for (size_t cell_id = 0; cell_id < (size_t)INIT_POP_SIZE; cell_id++) {
+      Inject(Cell(0, random_ptr->P(.5)));
+    }
+
+    occupied_bits.Resize(GetSize());
+    next_bits.Resize(GetSize());
+    for (size_t cell_id = 0; cell_id < GetSize(); cell_id++) {
+      if (IsOccupied(cell_id)) {
+        occupied_bits.Set(cell_id);
       }
+    }
+  }
 
+  /// Make occupied_mask/producer_mask reflect the current population. The
+  /// population only changes in RunStep/Update, so this is a no-op for all
+  /// but the first diffusion step of each update.
+  void RefreshCellMasks() override {
+    if (mask_update == GetUpdate() && occupied_mask.size() == GetSize()) {
+      return;
+    }
+    occupied_mask.assign(GetSize(), 0);
+    producer_mask.assign(GetSize(), 0);
+    occupied_bits.ForEachSet(0, GetSize(), [this](size_t cell_id){
+      occupied_mask[cell_id] = 1;
+      producer_mask[cell_id] = GetOrg(cell_id).producer;
+    });
+    mask_update = GetUpdate();
   }
 
   void Reset(PublicGoodsConfig & config, bool web = false) {
     emp::World<Cell>::Reset();
-    if (public_good) {
-      public_good.Delete();
-      public_good = nullptr;
-    }
+    DeletePublicGood();
     Setup(config, web);    
   }
 
   void Setup(PublicGoodsConfig & config, bool web = false) {
     InitConfigs(config);
-    public_good.New(WORLD_X, WORLD_Y, WORLD_Z);
-    public_good->SetDiffusionCoefficient(PUBLIC_GOOD_DIFFUSION_COEFFICIENT);
+    if (PARALLEL_CELL_UPDATE) {
+      std::cerr << "Warning: PARALLEL_CELL_UPDATE needs WORLD_ENGINE grid; updating cells serially" << std::endl;
+    }
+    mask_update = (size_t)-1;
+    NewPublicGood();
 
     if (!web) { // Web version needs to do diffusion separately to visualize
       OnUpdate([this](int ud){
-        for (int i = 0; i < DIFFUSION_STEPS_PER_TIME_STEP; i++) {
-          UpdatePublicGood();
-        }
+        UpdatePublicGood(DIFFUSION_STEPS_PER_TIME_STEP);
       });
     }
 
 
     // SetupFitnessFile().SetTimingRepeat(config.DATA_RESOLUTION());
-    SetupPopulationFile().SetTimingRepeat(config.DATA_RESOLUTION());
 
     SetPopStruct_3DGrid(WORLD_X, WORLD_Y, WORLD_Z, true);
     InitPublicGood();
@@ -199,51 +847,20 @@ class HCAWorld : public emp::World<Cell> {
     SetSynchronousSystematics(true);
   }
 
-  void BasalPublicGoodConsumption() {
-    for (size_t cell_id = 0; cell_id < pop.size(); cell_id++) {
-      if (IsOccupied(cell_id)) {
-        size_t x = cell_id % WORLD_X;
-        size_t y = (cell_id / WORLD_X) % WORLD_Y;
-        size_t z = (cell_id / WORLD_X) / WORLD_Y;
-        double public_good_loss_multiplier = public_good->GetVal(x, y, z);
-        public_good_loss_multiplier /= public_good_loss_multiplier + KM;
-        public_good->DecNextVal(x, y, 0, BASAL_PUBLIC_GOOD_CONSUMPTION * public_good_loss_multiplier);
-        // std::cout << "Decrementing: " << BASAL_PUBLIC_GOOD_CONSUMPTION * public_good_loss_multiplier << std::endl;
-      }
-    }
-  }
-
-
   /// Determine if cell can divide (i.e. is space available). If yes, return
   /// id of cell that it can divide into. If not, return -1.
   int CanDivide(size_t cell_id) {
-    emp::vector<int> open_spots;
-    int x_coord = (int)(cell_id % WORLD_X);
-    int y_coord = (int)((cell_id / WORLD_X) % WORLD_Y);
-    int z_coord = (int)((cell_id / WORLD_X) / WORLD_Y);
-    
-    // Iterate over 9-cell neighborhood. Currently checks focal cell uneccesarily,
-    // but that shouldn't cause problems because it will never show up as invasible.
-    for (int x = std::max(0, x_coord-1); x < std::min((int)WORLD_X, x_coord + 2); x++) {
-      for (int y = std::max(0, y_coord-1); y < std::min((int)WORLD_Y, y_coord + 2); y++) {
-        for (int z = std::max(0, z_coord-1); z < std::min((int)WORLD_Z, z_coord + 2); z++) {
-          int this_cell = z*(int)WORLD_Y*(int)WORLD_X + y*(int)WORLD_X + x;
-          // Cells can be divided into if they are empty or if they are healthy and the
-          // dividing cell is cancerous
-          if (!IsOccupied((size_t)this_cell)) {
-            open_spots.push_back(this_cell);
-          }
-        }
-      }
-    }
-    
+    // Cells can be divided into if they are empty
+    const uint32_t open_spots = occupied_bits.EmptyNeighbors(neighbors, cell_id);
+
     // -1 is a sentinel value indicating no spots are available
-    if (open_spots.size() == 0) {
+    if (open_spots == 0) {
       return -1;
     }
 
     // If there are one or more available spaces, return a random spot
-    return open_spots[random_ptr->GetUInt(0, open_spots.size())];
+    const size_t pick = random_ptr->GetUInt(0, OccupancyBitset::CountBits(open_spots));
+    return (int)neighbors.GetNeighbor(cell_id, OccupancyBitset::SelectBit(open_spots, pick));
   }
 
   int Mutate(emp::Ptr<Cell> c){
@@ -259,25 +876,26 @@ class HCAWorld : public emp::World<Cell> {
     // std::cout << "Quieseing" << std::endl;
     pop[cell_id]->age++;
     if (pop[cell_id]->age < AGE_LIMIT) {
+      HCA_PROFILE_COUNT(QUIESCENCES);
       emp::Ptr<Cell> cell = emp::NewPtr<Cell>(*pop[cell_id]);
       AddOrgAt(cell, emp::WorldPosition(cell_id,1), cell_id);      
+      next_bits.Set(cell_id);
+    } else {
+      HCA_PROFILE_COUNT(DEATHS);
     }
   }
 
   void RunStep() {
-    std::cout << update << std::endl;
-
-    for (size_t cell_id = 0; cell_id < WORLD_X * WORLD_Y * WORLD_Z; cell_id++) {
-      if (!IsOccupied(cell_id)) {
-        // Don't need to do anything for dead/empty cells
-        continue;
+    if (show_progress) Logger::Get().Progress(update);
+
+    // Don't need to do anything for dead/empty cells
+    const size_t num_cells = WORLD_X * WORLD_Y * WORLD_Z;
+    HCA_PROFILE_BEGIN(CELL_FATES);
+    for (size_t cell_id = occupied_bits.FindNext(0); cell_id < num_cells; cell_id = occupied_bits.FindNext(cell_id + 1)) {
+      double death_prob = DRUG_CONCENTRATION - pop[cell_id]->resistance - GetCellPublicGood(cell_id);
+      if (!extra_fields.empty()) {
+        death_prob += GetCellFieldEffect(cell_id);
       }
-
-      size_t x = cell_id % WORLD_X;
-      size_t y = (cell_id / WORLD_X) % WORLD_Y;
-      size_t z = (cell_id / WORLD_X) / WORLD_Y;
-
-      double death_prob = DRUG_CONCENTRATION - pop[cell_id]->resistance - public_good->GetVal(x, y, z);
       if (death_prob > 1) {
         death_prob = 1;
       } else if (death_prob < 0) {
@@ -285,6 +903,7 @@ class HCAWorld : public emp::World<Cell> {
       }
 
       if (random_ptr->P(death_prob)) {
+        HCA_PROFILE_COUNT(DEATHS);
         continue; // Continuing without adding to next generation = death  
       }
 
@@ -304,11 +923,13 @@ class HCAWorld : public emp::World<Cell> {
       
       if (potential_offspring_cell != -1 && random_ptr->P(repro_prob)) {
         // Handle daughter cell in previously empty spot
+        HCA_PROFILE_COUNT(DIVISIONS);
         before_repro_sig.Trigger(cell_id);
         emp::Ptr<Cell> offspring = emp::NewPtr<Cell>(*pop[cell_id]);
         Mutate(offspring);
         offspring_ready_sig.Trigger(*offspring, cell_id);
         AddOrgAt(offspring, emp::WorldPosition((size_t)potential_offspring_cell, 1), cell_id);
+        next_bits.Set((size_t)potential_offspring_cell);
 
         // Handle daughter cell in current location
         before_repro_sig.Trigger(cell_id);
@@ -316,19 +937,83 @@ class HCAWorld : public emp::World<Cell> {
         Mutate(offspring);
         offspring_ready_sig.Trigger(*offspring, cell_id);
         AddOrgAt(offspring, emp::WorldPosition(cell_id,1), cell_id);
+        next_bits.Set(cell_id);
         // std::cout << "Mutated: " << offspring->clade << std::endl;
       } else {        
         Quiesce(cell_id);
       }
     }
 
+    HCA_PROFILE_END();
     Update();
+    CheckpointIfDue(GetUpdate());
+    SnapshotIfDue(GetUpdate());
+    ProfileIfDue(GetUpdate());
+  }
+
+  Checkpoint GetCheckpoint() override {
+    Checkpoint cp;
+    cp.Resize(WORLD_X, WORLD_Y, WORLD_Z);
+    cp.update = GetUpdate();
+    SaveRandom(*random_ptr, cp);
+    SaveField(cp);
+    occupied_bits.ForEachSet(0, occupied_bits.size(), [this, &cp](size_t cell_id){
+      const Cell & cell = GetOrg(cell_id);
+      cp.occupied[cell_id] = 1;
+      cp.producer[cell_id] = cell.producer;
+      cp.age[cell_id] = cell.age;
+      cp.resistance[cell_id] = cell.resistance;
+    });
+    return cp;
+  }
+
+  /// Continue the run saved in checkpoint @param filename. Call after
+  /// Setup() with the same config. The systematics restart from the saved
+  /// population.
+  bool LoadCheckpoint(const std::string & filename) {
+    Checkpoint cp;
+    if (!ReadCheckpoint(filename, cp) || !LoadRandom(*random_ptr, cp)) return false;
+
+    for (size_t cell_id = 0; cell_id < GetSize(); cell_id++) {
+      if (IsOccupied(cell_id)) {
+        RemoveOrgAt(emp::WorldPosition(cell_id));
+      }
+    }
+    occupied_bits.Clear();
+    next_bits.Clear();
+    for (size_t cell_id = 0; cell_id < cp.GetSize(); cell_id++) {
+      if (cp.occupied[cell_id]) {
+        Cell cell(cp.resistance[cell_id], cp.producer[cell_id]);
+        cell.age = cp.age[cell_id];
+        InjectAt(cell, emp::WorldPosition(cell_id));
+        occupied_bits.Set(cell_id);
+      }
+    }
+
+    update = cp.update;
+    mask_update = (size_t)-1;
+    LoadField(cp);
+    return true;
+  }
+
+  /// emp::World::Update(), keeping occupied_bits in step with the
+  /// generation swap. All placements go through RunStep(), which marks
+  /// them in next_bits.
+  void Update() {
+    HCA_PROFILE_SCOPE(WORLD_UPDATE);
+    PopulationIfDue(GetUpdate(), GetNumOrgs());
+    emp::World<Cell>::Update();
+    occupied_bits.Swap(next_bits);
+    next_bits.Clear();
   }
 
   void Run() {
-      for (int u = 0; u <= TIME_STEPS; u++) {
+      Logger::Get().StartProgress(GetUpdate(), (size_t)TIME_STEPS + 1);
+      for (int u = (int)GetUpdate(); u <= TIME_STEPS; u++) {
           RunStep();
       }
+      Logger::Get().FinishProgress(GetUpdate());
+      FinishProfile();
   }
 
 };
@@ -0,0 +1,111 @@
+#ifndef _PixelCanvas_H
+#define _PixelCanvas_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "base/vector.h"
+#include "web/web.h"
+
+/// RGBA color packed so that its bytes lie in memory in R, G, B, A order
+/// (WebAssembly is little-endian), the layout ImageData expects.
+inline uint32_t PackRGBA(int r, int g, int b, int a = 255) {
+  return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+}
+
+/// The colors emp::ColorHSL(hue, 50, 50) names, for every whole degree of
+/// hue, so that drawing a voxel is a table lookup instead of building and
+/// parsing a color string.
+class HueLUT {
+  std::array<uint32_t, 360> colors;
+
+  public:
+  HueLUT() {
+    // CSS hsl() with saturation and lightness 50%
+    const double chroma = 0.5;
+    const double light = 0.5 - chroma / 2;
+    for (size_t hue = 0; hue < colors.size(); hue++) {
+      const double sector = hue / 60.0;
+      const double x = chroma * (1 - std::abs(std::fmod(sector, 2.0) - 1));
+      double r = 0, g = 0, b = 0;
+      switch ((int)sector) {
+        case 0: r = chroma; g = x; break;
+        case 1: r = x; g = chroma; break;
+        case 2: g = chroma; b = x; break;
+        case 3: g = x; b = chroma; break;
+        case 4: r = x; b = chroma; break;
+        default: r = chroma; b = x; break;
+      }
+      colors[hue] = PackRGBA((int)std::lround((r + light) * 255), (int)std::lround((g + light) * 255),
+                             (int)std::lround((b + light) * 255));
+    }
+  }
+
+  /// Color of @param hue in degrees, wrapped into [0, 360)
+  uint32_t operator()(double hue) const {
+    int degree = (int)hue % 360;
+    if (degree < 0) degree += 360;
+    return colors[degree];
+  }
+};
+
+/// An RGBA image with one pixel per voxel of a grid layer. It is filled
+/// in WASM memory and shown on an emp::web::Canvas with one putImageData
+/// (into an offscreen canvas of the same size) and one scaled drawImage,
+/// instead of a Rect call and color string per voxel.
+class PixelCanvas {
+  size_t width = 0;
+  size_t height = 0;
+  emp::vector<uint32_t> pixels;
+
+  public:
+  PixelCanvas() {;}
+
+  void Resize(size_t in_width, size_t in_height) {
+    width = in_width;
+    height = in_height;
+    pixels.assign(width * height, PackRGBA(0, 0, 0));
+  }
+
+  size_t GetWidth() const {return width;}
+  size_t GetHeight() const {return height;}
+
+  /// The pixels of row @param y
+  uint32_t * Row(size_t y) {return pixels.data() + y * width;}
+
+  void Set(size_t x, size_t y, uint32_t rgba) {pixels[y * width + x] = rgba;}
+
+  void Fill(uint32_t rgba) {std::fill(pixels.begin(), pixels.end(), rgba);}
+
+  /// Draw the image over the whole of @param canvas, one block of pixels
+  /// per voxel without smoothing
+  void Blit(emp::web::Canvas & canvas) {
+    if (pixels.empty()) return;
+    EM_ASM({
+      var canvas = document.getElementById(UTF8ToString($0));
+      if (!canvas) return;
+      var width = $2;
+      var height = $3;
+      var buffer = canvas.hcaPixelBuffer;
+      if (!buffer || buffer.width != width || buffer.height != height) {
+        buffer = document.createElement('canvas');
+        buffer.width = width;
+        buffer.height = height;
+        canvas.hcaPixelBuffer = buffer;
+      }
+      var data = new Uint8ClampedArray(HEAPU8.buffer, $1, width * height * 4);
+      // ImageData cannot wrap shared memory (pthread builds); copy it out
+      if (typeof SharedArrayBuffer !== 'undefined' && HEAPU8.buffer instanceof SharedArrayBuffer) {
+        data = data.slice();
+      }
+      buffer.getContext('2d').putImageData(new ImageData(data, width, height), 0, 0);
+      var ctx = canvas.getContext('2d');
+      ctx.imageSmoothingEnabled = false;
+      ctx.drawImage(buffer, 0, 0, canvas.width, canvas.height);
+    }, canvas.GetID().c_str(), pixels.data(), (int)width, (int)height);
+  }
+};
+
+#endif
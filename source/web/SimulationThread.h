@@ -0,0 +1,199 @@
+#ifndef _SimulationThread_H
+#define _SimulationThread_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "base/vector.h"
+#include "../public_goods_model.h"
+
+/// What the web displays show of one update: the public good in the
+/// z = 0 layer and in the (y, z) slice through the middle of x, and the
+/// cells of one layer.
+struct WebFrame {
+  size_t update = 0;
+  size_t x_len = 0, y_len = 0, z_len = 0;
+  size_t layer = 0;                      // z of the cell values
+  emp::vector<float> public_good;        // x + y * x_len
+  emp::vector<float> public_good_side;   // z + y * z_len, at x = x_len / 2
+  emp::vector<unsigned char> occupied;   // x + y * x_len, in layer
+  emp::vector<unsigned char> producer;
+  emp::vector<int> age;
+  emp::vector<float> resistance;
+
+  bool operator==(const WebFrame & other) const {
+    return update == other.update && layer == other.layer && public_good == other.public_good
+           && public_good_side == other.public_good_side && occupied == other.occupied
+           && producer == other.producer && age == other.age && resistance == other.resistance;
+  }
+
+  /// Copy the state of @param world, with the cells of z = @param in_layer
+  void Capture(HCAWorld & world, size_t in_layer) {
+    update = world.GetUpdate();
+    x_len = world.GetWorldX();
+    y_len = world.GetWorldY();
+    z_len = world.GetWorldZ();
+    layer = std::min(in_layer, z_len - 1);
+
+    public_good.resize(x_len * y_len);
+    public_good_side.resize(z_len * y_len);
+    occupied.assign(x_len * y_len, 0);
+    producer.assign(x_len * y_len, 0);
+    age.assign(x_len * y_len, 0);
+    resistance.assign(x_len * y_len, 0);
+
+    for (size_t y = 0; y < y_len; y++) {
+      for (size_t x = 0; x < x_len; x++) {
+        public_good[x + y * x_len] = (float)world.GetPublicGoodVal(x, y);
+      }
+      for (size_t z = 0; z < z_len; z++) {
+        public_good_side[z + y * z_len] = (float)world.GetPublicGoodVal(x_len / 2, y, z);
+      }
+    }
+
+    const size_t layer_start = layer * x_len * y_len;
+    for (size_t i = 0; i < x_len * y_len; i++) {
+      if (!world.IsOccupied(layer_start + i)) continue;
+      const Cell & cell = world.GetOrg(layer_start + i);
+      occupied[i] = 1;
+      producer[i] = cell.producer;
+      age[i] = cell.age;
+      resistance[i] = (float)cell.resistance;
+    }
+  }
+};
+
+/// Runs a model on a thread of its own (a Web Worker when built with
+/// Emscripten pthreads), so that the browser's main thread only draws.
+///
+/// The thread calls the step function as fast as it can while running,
+/// and after every step (and every command) captures a frame into its
+/// back buffer and swaps it with the published one. The UI takes the
+/// published frame with TakeFrame(), which never waits: if the thread is
+/// publishing at that moment, the UI simply draws on its next animation
+/// frame. Everything else that touches the model from the UI (reset,
+/// clicks, settings) goes through Post() and runs on the thread between
+/// steps.
+class SimulationThread {
+  public:
+  using step_fun_t = std::function<bool()>;            // Advance one update; false when there is nothing left to do
+  using capture_fun_t = std::function<void(WebFrame &)>;
+  using command_t = std::function<void()>;
+
+  private:
+  step_fun_t step_fun;
+  capture_fun_t capture_fun;
+
+  std::thread thread;
+  std::mutex mutex;               // Guards commands and wakes the thread
+  std::condition_variable wake;
+  emp::vector<command_t> commands;
+  std::atomic<bool> running{false};
+  std::atomic<bool> stopping{false};
+
+  std::mutex frame_mutex;         // Guards published and fresh
+  WebFrame back;                  // Owned by the thread
+  WebFrame published;
+  bool fresh = false;
+  std::atomic<size_t> steps{0};
+
+  void Publish() {
+    capture_fun(back);
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    std::swap(back, published);
+    fresh = true;
+  }
+
+  /// Run the queued commands; @return whether there were any
+  bool RunCommands() {
+    emp::vector<command_t> todo;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      todo.swap(commands);
+    }
+    for (command_t & command : todo) command();
+    return !todo.empty();
+  }
+
+  void Loop() {
+    Publish();
+    while (!stopping.load()) {
+      if (RunCommands()) Publish();
+      if (running.load()) {
+        if (step_fun()) {
+          steps++;
+          Publish();
+        } else {
+          running = false;
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait_for(lock, std::chrono::milliseconds(100), [this](){
+        return stopping.load() || running.load() || !commands.empty();
+      });
+    }
+  }
+
+  public:
+  SimulationThread(const step_fun_t & in_step, const capture_fun_t & in_capture)
+    : step_fun(in_step), capture_fun(in_capture) {;}
+
+  SimulationThread(const SimulationThread &) = delete;
+  SimulationThread & operator=(const SimulationThread &) = delete;
+
+  ~SimulationThread() {Stop();}
+
+  /// Start the thread (paused), once the model is set up. It publishes a
+  /// frame of the initial state straight away.
+  void Start() {
+    if (thread.joinable()) return;
+    stopping = false;
+    thread = std::thread([this](){ Loop(); });
+  }
+
+  void Stop() {
+    stopping = true;
+    wake.notify_one();
+    if (thread.joinable()) thread.join();
+  }
+
+  void SetRunning(bool run) {
+    running = run;
+    wake.notify_one();
+  }
+
+  bool GetRunning() const {return running.load();}
+
+  /// Steps run since the thread started
+  size_t GetSteps() const {return steps.load();}
+
+  /// Run @param command on the simulation thread before its next step;
+  /// a frame is published after it
+  void Post(const command_t & command) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      commands.push_back(command);
+    }
+    wake.notify_one();
+  }
+
+  /// Swap the newest published frame into @param frame if there is one
+  /// that has not been taken yet. @return whether @param frame changed.
+  /// Never blocks.
+  bool TakeFrame(WebFrame & frame) {
+    std::unique_lock<std::mutex> lock(frame_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !fresh) return false;
+    std::swap(frame, published);
+    fresh = false;
+    return true;
+  }
+};
+
+#endif
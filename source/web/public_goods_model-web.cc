@@ -5,6 +5,8 @@
 #include "web/web.h"
 #include "web/color_map.h"
 #include "../public_goods_model.h"
+#include "PixelCanvas.h"
+#include "SimulationThread.h"
 #include "config/config_web_interface.h"
 #include "tools/spatial_stats.h"
 
@@ -14,8 +16,8 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
   // friend class HCAWorld;
   // friend class UI::Animate;
 
-  using color_fun_t = std::function<std::string(int)>;
-  using should_draw_fun_t = std::function<bool(int)>;
+  using color_fun_t = std::function<double(size_t)>; // Hue of a cell, by its index in the frame's layer
+  using should_draw_fun_t = std::function<bool(size_t)>;
 
   PublicGoodsConfig config;
   emp::ConfigWebUI config_ui;
@@ -33,39 +35,54 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
   // UI::Canvas clade_display;
   const double display_cell_size = 7;
 
+  // One pixel per voxel of each display, and their colors
+  PixelCanvas public_good_pixels;
+  PixelCanvas public_good_vertical_pixels;
+  PixelCanvas cell_pixels;
+  HueLUT hues;
+
   UI::Button toggle;
   UI::Style button_style;
   bool draw_cells = true;
-  int draw_layer = 0;
+  std::atomic<int> draw_layer{0};
+
+  // The update on display. With pthreads (make web-threads) the model runs
+  // on its own thread, which hands over finished frames; otherwise the
+  // frame is captured here after each update.
+  WebFrame frame;
+#ifdef __EMSCRIPTEN_PTHREADS__
+  SimulationThread simulation;
+#endif
 
 
   color_fun_t cell_color_fun;
   UI::Selector cell_color_control;
   UI::Selector cell_layer_control;
 
-  color_fun_t age_color_fun = [this](int cell_id) {
-                                        double hue = (pop[cell_id]->age/AGE_LIMIT) * 280.0;
-                                        return emp::ColorHSL(hue,50,50);
+  color_fun_t age_color_fun = [this](size_t i) {
+                                        return (frame.age[i]/AGE_LIMIT) * 280.0;
                                      };
 
-  color_fun_t producer_color_fun = [this](int cell_id) {
-                                        double hue = 100 + pop[cell_id]->producer * 100;
-                                        return emp::ColorHSL(hue,50,50);
+  color_fun_t producer_color_fun = [this](size_t i) {
+                                        return 100 + frame.producer[i] * 100;
                                      };
 
-  color_fun_t resistance_color_fun = [this](int cell_id) {
-                                        double hue = 100 + pop[cell_id]->resistance * 100;
-                                        return emp::ColorHSL(hue,50,50);
+  color_fun_t resistance_color_fun = [this](size_t i) {
+                                        return 100 + frame.resistance[i] * 100;
                                      };
 
   should_draw_fun_t should_draw_cell_fun;
-  should_draw_fun_t draw_if_occupied = [this](int cell_id){return IsOccupied(cell_id);};
-  should_draw_fun_t always_draw = [](int cell_id){return true;};
+  should_draw_fun_t draw_if_occupied = [this](size_t i){return frame.occupied[i];};
+  should_draw_fun_t always_draw = [](size_t i){return true;};
 
   public:
   HCAWebInterface() : config_ui(config), public_good_area("public_good_area"), cell_area("cell_area"), controls("control_area"), stats_area("stats_area"),
     public_good_display(100, 100, "public_good_display"), public_good_vertical_display(100, 100, "public_good_vertical_display"), cell_display(100, 100, "cell_display"),
     cell_color_control("cell_color_control"), cell_layer_control("cell_layer_control")
+#ifdef __EMSCRIPTEN_PTHREADS__
+    , simulation([this](){ UpdatePublicGood(DIFFUSION_STEPS_PER_TIME_STEP); RunStep(); return true; },
+                 [this](WebFrame & next){ next.Capture(*this, (size_t)draw_layer.load()); })
+#endif
     // : anim([this](){DoFrame();}, public_good_display, cell_display) 
   {
     SetupInterface();   
@@ -86,6 +103,10 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
     cell_display.SetSize(WORLD_X * display_cell_size, WORLD_Y * display_cell_size);
     cell_display.Clear("black");
 
+    public_good_pixels.Resize(WORLD_X, WORLD_Y);
+    public_good_vertical_pixels.Resize(WORLD_Z, WORLD_Y);
+    cell_pixels.Resize(WORLD_X, WORLD_Y);
+
     public_good_area << "<h1 class='text-center'>Public Good</h1>" << public_good_vertical_display << " " << public_good_display ;
     cell_area << "<h1 class='text-center'>Cells</h1>" << cell_display;
     controls << "<h1 class='text-center'>Controls</h1>";
@@ -119,22 +140,32 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
       cell_layer_control.SetOption(emp::to_string(i),
                                   [this, i]() {
                                     draw_layer = i;
-                                    RedrawCells();
+                                    OnModel([](){});
                                   }, i);
     }
 
+#ifdef __EMSCRIPTEN_PTHREADS__
+    // The animation only draws, so it always runs; this starts and stops
+    // the simulation thread
+    toggle = UI::Button([this](){
+                          simulation.SetRunning(!simulation.GetRunning());
+                          toggle.SetLabel(simulation.GetRunning() ? "Stop" : "Start");
+                        }, "Start", "but_toggle");
+#else
     toggle = GetToggleButton("but_toggle");
+#endif
     button_style.AddClass("btn");
     button_style.AddClass("btn-primary");
     toggle.SetCSS(button_style);
 
-    UI::Button reset_button([this](){Reset(config, true); RedrawCells(); RedrawPublicGood();}, "Reset");
+    UI::Button reset_button([this](){OnModel([this](){Reset(config, true);});}, "Reset");
     reset_button.SetCSS(button_style);
     
     controls << toggle;
     controls << " " << reset_button << " " << cell_color_control << " " << cell_layer_control << "<br>";
 
     public_good_display.On("click", [this](int x, int y){PublicGoodClick(x, y);});;
+    frame.Capture(*this, 0);
     RedrawPublicGood();
     RedrawCells();
     
@@ -143,7 +174,7 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
         EM_ASM($('select').selectpicker('setStyle', 'btn-primary'););
     });
 
-    config_ui.SetOnChangeFun([this](const std::string & val){ std::cout << "New val: " << val<<std::endl;;InitConfigs(config);});
+    config_ui.SetOnChangeFun([this](const std::string & val){ std::cout << "New val: " << val<<std::endl;;OnModel([this](){InitConfigs(config);});});
     config_ui.ExcludeConfig("SEED");
     config_ui.ExcludeConfig("TIME_STEPS");
     config_ui.ExcludeConfig("WORLD_X");
@@ -153,7 +184,7 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
     config_ui.Setup();
     controls << config_ui.GetDiv();
 
-    stats_area << "<br>Time step: " << emp::web::Live( [this](){ return GetUpdate(); } );
+    stats_area << "<br>Time step: " << emp::web::Live( [this](){ return frame.update; } );
     // stats_area << "<br>Extant taxa: " << emp::web::Live( [this](){ return systematics[0].DynamicCast<emp::Systematics<Cell, int>>()->GetNumActive(); } );
     // stats_area << "<br>Shannon diversity: " << emp::web::Live( [this](){ return systematics[0].DynamicCast<emp::Systematics<Cell, int>>()->CalcDiversity(); } );
     // stats_area << "<br>Sackin Index: " << emp::web::Live( [this](){ return systematics[0].DynamicCast<emp::Systematics<Cell, int>>()->SackinIndex(); } );
@@ -163,82 +194,96 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
     // stats_area << "<br>Variance pairwise distance: " << emp::web::Live( [this](){ return systematics[0].DynamicCast<emp::Systematics<Cell, int>>()->GetVariancePairwiseDistance(); } );
   }
 
+  /// Start the simulation thread and the animation that draws its
+  /// frames, if there is one
+  void StartSimulation() {
+#ifdef __EMSCRIPTEN_PTHREADS__
+    simulation.Start();
+    UI::Animate::Start();
+#endif
+  }
+
+  /// Run @param fn on the model (on the simulation thread, if there is
+  /// one) and show the result
+  void OnModel(const std::function<void()> & fn) {
+#ifdef __EMSCRIPTEN_PTHREADS__
+    simulation.Post(fn);
+#else
+    fn();
+    frame.Capture(*this, (size_t)draw_layer.load());
+    Redraw();
+#endif
+  }
+
   void DoFrame() {
     // std::cout << frame_count << " " << GetStepTime() << std::endl;
+#ifdef __EMSCRIPTEN_PTHREADS__
+    // Draw the latest frame from the simulation thread, if it is new
+    if (simulation.TakeFrame(frame)) {
+      Redraw();
+      stats_area.Redraw();
+    }
+#else
     UpdatePublicGood();
 
     if (frame_count % DIFFUSION_STEPS_PER_TIME_STEP == 0) {
       RunStep();
-      RedrawPublicGood();
-      if (draw_cells) {
-        RedrawCells();
-      }
+      frame.Capture(*this, (size_t)draw_layer.load());
+      Redraw();
     }
 
     stats_area.Redraw();
+#endif
   }
 
-  void RedrawPublicGood() {
-    // public_good_display.SetSize(WORLD_X * display_cell_size, WORLD_Y * display_cell_size);
-    public_good_display.Freeze();
-    public_good_display.Clear("black");
-
-    for (size_t x = 0; x < WORLD_X; x++) {
-      for (size_t y = 0; y < WORLD_Y; y++) {
-        double o2 = public_good->GetVal(x,y);
-
-        o2 *= 280;
-        if (o2 > 280) {
-          o2 = 280;
-        } else if (o2 < 0) {
-          o2 = 0;
-        }
-        std::string color = emp::ColorHSL(o2,50,50);
-        public_good_display.Rect(x*display_cell_size, y*display_cell_size, display_cell_size, display_cell_size, color, color);
-      }
+  void Redraw() {
+    RedrawPublicGood();
+    if (draw_cells) {
+      RedrawCells();
     }
+  }
 
-    public_good_display.Activate();
+  /// Hue of a public good level
+  static double PublicGoodHue(double o2) {
+    o2 *= 280;
+    if (o2 > 280) {
+      o2 = 280;
+    } else if (o2 < 0) {
+      o2 = 0;
+    }
+    return o2;
+  }
 
-    public_good_vertical_display.Freeze();
-    public_good_vertical_display.Clear("black");
+  void RedrawPublicGood() {
+    for (size_t y = 0; y < frame.y_len; y++) {
+      uint32_t * row = public_good_pixels.Row(y);
+      const float * vals = frame.public_good.data() + y * frame.x_len;
+      for (size_t x = 0; x < frame.x_len; x++) {
+        row[x] = hues(PublicGoodHue(vals[x]));
+      }
+    }
+    public_good_pixels.Blit(public_good_display);
 
-    for (size_t z = 0; z < WORLD_Z; z++) {
-      for (size_t y = 0; y < WORLD_Y; y++) {
-        double o2 = public_good->GetVal(WORLD_X/2,y,z);
-
-        o2 *= 280;
-        if (o2 > 280) {
-          o2 = 280;
-        } else if (o2 < 0) {
-          o2 = 0;
-        }
-        std::string color = emp::ColorHSL(o2,50,50);
-        public_good_vertical_display.Rect((WORLD_Z - z - 1)*display_cell_size, y*display_cell_size, display_cell_size, display_cell_size, color, color);
+    for (size_t y = 0; y < frame.y_len; y++) {
+      uint32_t * row = public_good_vertical_pixels.Row(y);
+      const float * vals = frame.public_good_side.data() + y * frame.z_len;
+      for (size_t z = 0; z < frame.z_len; z++) {
+        row[frame.z_len - z - 1] = hues(PublicGoodHue(vals[z]));
       }
     }
-    public_good_vertical_display.Activate();
+    public_good_vertical_pixels.Blit(public_good_vertical_display);
   }
 
   void RedrawCells(){
-    // cell_display.SetSize(WORLD_X * display_cell_size, WORLD_Y * display_cell_size);
-    cell_display.Freeze();
-    cell_display.Clear("black");
-
-    for (size_t x = 0; x < WORLD_X; x++) {
-      for (size_t y = 0; y < WORLD_Y; y++) {
-        size_t cell_id = x + y * WORLD_X + draw_layer*WORLD_X*WORLD_Y;
-        if (should_draw_cell_fun(cell_id)) {
-          std::string color = cell_color_fun(cell_id);
-
-
-          cell_display.Rect(x*display_cell_size, y*display_cell_size, display_cell_size, display_cell_size, color, color);
-
-        }        
+    const uint32_t black = PackRGBA(0, 0, 0);
+    for (size_t y = 0; y < frame.y_len; y++) {
+      uint32_t * row = cell_pixels.Row(y);
+      for (size_t x = 0; x < frame.x_len; x++) {
+        const size_t i = x + y * frame.x_len;
+        row[x] = should_draw_cell_fun(i) ? hues(cell_color_fun(i)) : black;
       }
     }
-
-    cell_display.Activate();
+    cell_pixels.Blit(cell_display);
   }
 
   void PublicGoodClick(int x, int y) { 
@@ -255,8 +300,13 @@ class HCAWebInterface : public UI::Animate, public HCAWorld{
     size_t pos_x = (size_t) (WORLD_X * px);
     size_t pos_y = (size_t) (WORLD_Y * py);
     // std::cout << "x: " << x << " y: " << y << "WORLD_X: " << WORLD_X << " WORLD_Y: " << WORLD_Y << " canvas_x: " << canvas_x <<" canvas_y: " << canvas_y  << " px: " << px <<  " py: " << py <<" pos_x: " << pos_x << " pos_y: " << pos_y <<std::endl;
-    public_good->SetNextVal(pos_x, pos_y, 0, 1);
-    public_good->SetVal(pos_x, pos_y, 0, 1);
+    OnModel([this, pos_x, pos_y](){
+      WithPublicGood([pos_x, pos_y](auto & grad){
+        grad.SetNextVal(pos_x, pos_y, 0, 1);
+        grad.SetVal(pos_x, pos_y, 0, 1);
+      });
+      RetrackPublicGood();
+    });
   }
 };
 
@@ -265,4 +315,5 @@ HCAWebInterface interface;
 
 int main()
 {
+  interface.StartSimulation();
 }
@@ -0,0 +1,103 @@
+// Headless check of the threaded web build's simulation thread, run under
+// Node by make web-check (or natively, where std::thread is a thread):
+//
+//   worker_check [-updates N] [-x X] [-y Y] [-z Z]
+//
+// One world runs on a SimulationThread while this thread takes frames as
+// the web interface's animation does, without waiting for them. Once the
+// thread has run N updates, its final frame must match a second world
+// with the same seed stepped here, and the frames taken must have come in
+// update order.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "SimulationThread.h"
+
+PublicGoodsConfig MakeConfig(size_t x, size_t y, size_t z) {
+  PublicGoodsConfig config;
+  config.Set("WORLD_X", std::to_string(x));
+  config.Set("WORLD_Y", std::to_string(y));
+  config.Set("WORLD_Z", std::to_string(z));
+  config.Set("SEED", "1");
+  config.Set("POPULATION_FILE", "");
+  return config;
+}
+
+int main(int argc, char* argv[])
+{
+  size_t updates = 50;
+  size_t x = 50, y = 50, z = 10;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-updates" && i + 1 < argc) {
+      updates = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-x" && i + 1 < argc) {
+      x = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-y" && i + 1 < argc) {
+      y = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "-z" && i + 1 < argc) {
+      z = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-updates N] [-x X] [-y Y] [-z Z]" << std::endl;
+      return 1;
+    }
+  }
+  Logger::Get().SetLevel(Logger::QUIET);
+  const size_t layer = z / 2;
+
+  // On the simulation thread
+  PublicGoodsConfig config = MakeConfig(x, y, z);
+  emp::Random rnd(1);
+  HCAWorld world(rnd);
+  world.SetShowProgress(false);
+  world.Setup(config);
+  SimulationThread simulation([&world, updates](){
+                                if (world.GetUpdate() >= updates) return false;
+                                world.RunStep();
+                                return true;
+                              },
+                              [&world, layer](WebFrame & frame){ frame.Capture(world, layer); });
+
+  const auto start = std::chrono::steady_clock::now();
+  simulation.Start();
+  simulation.SetRunning(true);
+
+  WebFrame frame;
+  size_t taken = 0, polls = 0;
+  bool in_order = true;
+  size_t last_update = 0;
+  while (frame.update < updates) {
+    polls++;
+    if (simulation.TakeFrame(frame)) {
+      if (taken && frame.update < last_update) in_order = false;
+      last_update = frame.update;
+      taken++;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  simulation.Stop();
+
+  // The same run, here
+  PublicGoodsConfig serial_config = MakeConfig(x, y, z);
+  emp::Random serial_rnd(1);
+  HCAWorld serial(serial_rnd);
+  serial.SetShowProgress(false);
+  serial.Setup(serial_config);
+  while (serial.GetUpdate() < updates) serial.RunStep();
+  WebFrame expected;
+  expected.Capture(serial, layer);
+
+  const bool same = frame == expected;
+  std::cout << x << "x" << y << "x" << z << ": " << updates << " updates in " << seconds << " s on the simulation thread; "
+            << taken << " frames taken in " << polls << " polls" << std::endl;
+  std::cout << "frames in update order: " << (in_order ? "yes" : "no") << std::endl;
+  std::cout << "final frame matches a serial run: " << (same ? "yes" : "no") << std::endl;
+  return same && in_order ? 0 : 1;
+}
@@ -0,0 +1,866 @@
+// Regression tests for the guarantees the optimized code paths make (make
+// test): each faster path must reproduce the straightforward one exactly,
+// and state written to disk must read back unchanged.
+//
+//   unit_tests
+//
+// Every check prints one line; the exit status is the number that failed.
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../source/HCAGridWorld.h"
+#include "../source/Sweep.h"
+
+size_t failures = 0;
+
+void Check(bool ok, const std::string & what) {
+  std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+  if (!ok) failures++;
+}
+
+/// Whether @param a and @param b hold the same bits, so that -0.0 and 0.0
+/// differ and NaNs compare equal to themselves
+template <typename T>
+bool SameBits(const T & a, const T & b) {
+  return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+template <typename T>
+bool SameGrid(const BasicResourceGradient<T> & a, const BasicResourceGradient<T> & b,
+              size_t x_len, size_t y_len, size_t z_len) {
+  for (size_t z = 0; z < z_len; z++) {
+    for (size_t y = 0; y < y_len; y++) {
+      for (size_t x = 0; x < x_len; x++) {
+        if (!SameBits(a.GetVal(x, y, z), b.GetVal(x, y, z))) return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Whether two runs reached the same grids and cells. The random number
+/// generator is left out: its bytes include padding, which differs from
+/// run to run, and any difference in its sequence shows in the cells anyway.
+bool SameGridsAndCells(const Checkpoint & a, const Checkpoint & b) {
+  return a.x_len == b.x_len && a.y_len == b.y_len && a.z_len == b.z_len && a.update == b.update
+         && a.curr_field == b.curr_field && a.next_field == b.next_field
+         && a.occupied == b.occupied && a.producer == b.producer && a.age == b.age && a.resistance == b.resistance
+         && a.extra_fields == b.extra_fields && a.extra_curr_field == b.extra_curr_field
+         && a.extra_next_field == b.extra_next_field;
+}
+
+/// Whether two runs reached the same state, STEADY_STATE row state
+/// included (only runs with STEADY_STATE keep any)
+bool SameCheckpoint(const Checkpoint & a, const Checkpoint & b) {
+  return SameGridsAndCells(a, b) && a.steady_rows == b.steady_rows && a.steady_cells == b.steady_cells;
+}
+
+/// A small, quiet run on an @param x by @param y by @param z grid with
+/// the config @param settings (name, value pairs) on top
+PublicGoodsConfig MakeConfig(size_t x, size_t y, size_t z, const emp::vector<std::pair<std::string, std::string>> & settings) {
+  PublicGoodsConfig config;
+  config.Set("WORLD_X", std::to_string(x));
+  config.Set("WORLD_Y", std::to_string(y));
+  config.Set("WORLD_Z", std::to_string(z));
+  config.Set("INIT_POP_SIZE", std::to_string(x * y * z / 20));
+  config.Set("TIME_STEPS", "30");
+  config.Set("SEED", "1");
+  config.Set("VERBOSITY", "0");
+  config.Set("POPULATION_FILE", "");
+  for (const auto & setting : settings) {
+    config.Set(setting.first, setting.second);
+  }
+  return config;
+}
+
+/// State of an ENGINE world after running the config @param config
+template <typename ENGINE = HCAWorld>
+Checkpoint RunWorld(PublicGoodsConfig & config) {
+  emp::Random random(config.SEED());
+  ENGINE world(random);
+  world.SetShowProgress(false);
+  world.Setup(config);
+  world.Run();
+  return world.GetCheckpoint();
+}
+
+/// State of an ENGINE world after running the config @param config, but
+/// stopped after @param restart_at updates, written to a checkpoint file
+/// and continued from that file in a new world
+template <typename ENGINE = HCAWorld>
+Checkpoint RunWithRestart(PublicGoodsConfig & config, size_t restart_at) {
+  const std::string filename = (std::filesystem::temp_directory_path() / "hca_unit_tests_checkpoint.bin").string();
+  {
+    emp::Random random(config.SEED());
+    ENGINE world(random);
+    world.SetShowProgress(false);
+    world.Setup(config);
+    while (world.GetUpdate() < restart_at) world.RunStep();
+    if (!world.GetCheckpoint().Write(filename)) return Checkpoint();
+  }
+  emp::Random random(config.SEED() + 1); // Replaced by the checkpoint's
+  ENGINE world(random);
+  world.SetShowProgress(false);
+  world.Setup(config);
+  const bool loaded = world.LoadCheckpoint(filename);
+  std::remove(filename.c_str());
+  if (!loaded) return Checkpoint();
+  world.Run();
+  return world.GetCheckpoint();
+}
+
+/// Whether a 2D and a 3D run with @param settings end in the same state as
+/// with @param reference_settings
+bool SameRuns(const emp::vector<std::pair<std::string, std::string>> & settings,
+              const emp::vector<std::pair<std::string, std::string>> & reference_settings) {
+  const size_t dims[][3] = {{40, 30, 1}, {20, 18, 12}};
+  for (const auto & d : dims) {
+    PublicGoodsConfig config = MakeConfig(d[0], d[1], d[2], settings);
+    PublicGoodsConfig reference_config = MakeConfig(d[0], d[1], d[2], reference_settings);
+    if (!SameCheckpoint(RunWorld(config), RunWorld(reference_config))) return false;
+  }
+  return true;
+}
+
+// Like SameRuns(), but seeded with five cells on grids large enough that
+// most rows stay empty through the first updates, and only fill as the
+// population spreads
+bool SameSparseRuns(emp::vector<std::pair<std::string, std::string>> settings,
+                    emp::vector<std::pair<std::string, std::string>> reference_settings) {
+  const size_t dims[][3] = {{100, 100, 1}, {40, 40, 20}};
+  settings.push_back({"INIT_POP_SIZE", "5"});
+  reference_settings.push_back({"INIT_POP_SIZE", "5"});
+  for (const auto & d : dims) {
+    PublicGoodsConfig config = MakeConfig(d[0], d[1], d[2], settings);
+    PublicGoodsConfig reference_config = MakeConfig(d[0], d[1], d[2], reference_settings);
+    if (!SameGridsAndCells(RunWorld(config), RunWorld(reference_config))) return false;
+  }
+  return true;
+}
+
+// The vectorized row kernel against the scalar loop it stands in for, on
+// rows that do and do not fill whole vectors
+template <size_t DIMS, bool COMPENSATED, typename T>
+void TestRowKernel(const std::string & type_name) {
+  std::mt19937_64 rng(2);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  bool same = true;
+  for (size_t x_len = 3; x_len <= 70; x_len++) {
+    std::vector<T> rows[5], fast(x_len), scalar(x_len);
+    for (auto & row : rows) {
+      row.resize(x_len);
+      for (T & val : row) val = (T)uniform(rng);
+    }
+    for (size_t x = 0; x < x_len; x++) fast[x] = scalar[x] = (T)uniform(rng);
+    stencil::RowInterior<DIMS, COMPENSATED>(rows[0].data(), rows[1].data(), rows[2].data(), rows[3].data(),
+                                            rows[4].data(), fast.data(), 1, x_len - 1, (T)0.13);
+    stencil::RowInteriorScalar<DIMS, COMPENSATED>(rows[0].data(), rows[1].data(), rows[2].data(), rows[3].data(),
+                                                  rows[4].data(), scalar.data(), 1, x_len - 1, (T)0.13);
+    for (size_t x = 0; x < x_len; x++) same = same && SameBits(fast[x], scalar[x]);
+  }
+  Check(same, "RowInterior matches RowInteriorScalar (" + type_name + ", " + std::to_string(DIMS) + "D"
+        + (COMPENSATED ? ", compensated)" : ")"));
+}
+
+// Diffuse() against the voxel-by-voxel DiffuseReference(), with and
+// without wrapping edges
+void TestDiffuse() {
+  const size_t dims[][3] = {{1, 1, 1}, {2, 1, 1}, {7, 5, 3}, {16, 9, 4}, {33, 17, 5}, {50, 50, 1}, {9, 1, 12}};
+  std::mt19937_64 rng(3);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  bool same = true;
+  for (const auto & d : dims) {
+    for (int toroidal = 0; toroidal < 2; toroidal++) {
+      ResourceGradient fast(d[0], d[1], d[2]);
+      fast.SetDiffusionCoefficient(0.13);
+      fast.SetToroidal(toroidal);
+      for (size_t z = 0; z < d[2]; z++) {
+        for (size_t y = 0; y < d[1]; y++) {
+          for (size_t x = 0; x < d[0]; x++) {
+            fast.SetVal(x, y, z, uniform(rng));
+            fast.SetNextVal(x, y, z, uniform(rng));
+          }
+        }
+      }
+      ResourceGradient reference(fast);
+      for (int step = 0; step < 3; step++) {
+        fast.Diffuse();
+        reference.DiffuseReference();
+        fast.Update();
+        reference.Update();
+      }
+      same = same && SameGrid(fast, reference, d[0], d[1], d[2]);
+    }
+  }
+  Check(same, "Diffuse matches DiffuseReference");
+}
+
+/// Solution of the dense system @param a x = @param b, by Gaussian
+/// elimination with partial pivoting
+std::vector<double> DenseSolve(std::vector<std::vector<double>> a, std::vector<double> b) {
+  const size_t n = b.size();
+  for (size_t col = 0; col < n; col++) {
+    size_t pivot = col;
+    for (size_t row = col + 1; row < n; row++) {
+      if (std::abs(a[row][col]) > std::abs(a[pivot][col])) pivot = row;
+    }
+    std::swap(a[col], a[pivot]);
+    std::swap(b[col], b[pivot]);
+    for (size_t row = col + 1; row < n; row++) {
+      const double factor = a[row][col] / a[col][col];
+      for (size_t k = col; k < n; k++) a[row][k] -= factor * a[col][k];
+      b[row] -= factor * b[col];
+    }
+  }
+  std::vector<double> x(n);
+  for (size_t i = n; i-- > 0;) {
+    double sum = b[i];
+    for (size_t k = i + 1; k < n; k++) sum -= a[i][k] * x[k];
+    x[i] = sum / a[i][i];
+  }
+  return x;
+}
+
+// The implicit line solver (Thomas, plus the Sherman-Morrison correction
+// when the axis wraps) against a dense solve of the same backward-Euler
+// system, for several lines solved together
+void TestLineSolver() {
+  std::mt19937_64 rng(11);
+  std::uniform_real_distribution<double> uniform(0.1, 1);
+  const double k = 0.7;
+  const size_t count = 3; // Lines, interleaved as the y and z solves lay them out
+  double max_error = 0;
+  for (size_t n : {1, 2, 3, 5, 9, 16}) {
+    for (int toroidal = 0; toroidal < 2; toroidal++) {
+      // I - k L, where a missing neighbor is the voxel itself or wraps
+      std::vector<std::vector<double>> a(n, std::vector<double>(n, 0));
+      for (size_t i = 0; i < n; i++) {
+        a[i][i] += 1;
+        for (long step : {-1L, 1L}) {
+          long j = (long)i + step;
+          if (j < 0 || j >= (long)n) j = toroidal ? (j + (long)n) % (long)n : (long)i;
+          a[i][i] += k;
+          a[i][(size_t)j] -= k;
+        }
+      }
+      implicit::LineSolver solver;
+      solver.Setup(n, k, toroidal);
+      std::vector<double> lines(n * count);
+      for (double & val : lines) val = uniform(rng);
+      const std::vector<double> rhs = lines;
+      solver.Solve(lines.data(), count, count, 1);
+      for (size_t j = 0; j < count; j++) {
+        std::vector<double> b(n);
+        for (size_t i = 0; i < n; i++) b[i] = rhs[i * count + j];
+        const std::vector<double> expected = DenseSolve(a, b);
+        for (size_t i = 0; i < n; i++) {
+          max_error = std::max(max_error, std::abs(lines[i * count + j] - expected[i]));
+        }
+      }
+    }
+  }
+  Check(max_error < 1e-12, "implicit line solver matches a dense solve");
+}
+
+// One implicit step with no sources keeps the total amount of public good
+// (the backward-Euler matrix has unit column sums with no-flux or wrapping
+// edges), and departs from the explicit step by O(D^2): halving D must
+// divide the difference by about four
+void TestImplicitDiffusion() {
+  const size_t x_len = 24, y_len = 20, z_len = 10, size = x_len * y_len * z_len;
+  const std::vector<unsigned char> none(size, 0);
+  const stencil::SourceTerms src = {none.data(), none.data(), 1, 0, 0, 0};
+  std::mt19937_64 rng(13);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::vector<double> start(size);
+  for (double & val : start) val = uniform(rng);
+
+  bool conserved = true;
+  double difference[2] = {0, 0};
+  const double coefs[2] = {2e-3, 1e-3};
+  for (size_t c = 0; c < 2; c++) {
+    for (int toroidal = 0; toroidal < 2; toroidal++) {
+      ResourceGradient implicit_grad(x_len, y_len, z_len);
+      implicit_grad.SetDiffusionCoefficient(coefs[c]);
+      implicit_grad.SetToroidal(toroidal);
+      double mass_before = 0;
+      for (size_t i = 0; i < size; i++) {
+        implicit_grad.SetVal(i % x_len, i / x_len % y_len, i / (x_len * y_len), start[i]);
+        mass_before += start[i];
+      }
+      ResourceGradient explicit_grad(implicit_grad);
+
+      implicit_grad.SetupImplicit(1);
+      implicit_grad.AddImplicitSources(src, 1, 0, implicit_grad.GetNumRows());
+      implicit_grad.SolveImplicitX(0, implicit_grad.GetNumRows());
+      implicit_grad.SolveImplicitY(0, z_len);
+      implicit_grad.SolveImplicitZ(0, y_len);
+      explicit_grad.Diffuse();
+      explicit_grad.Update();
+
+      double mass_after = 0;
+      for (size_t i = 0; i < size; i++) {
+        const size_t x = i % x_len, y = i / x_len % y_len, z = i / (x_len * y_len);
+        mass_after += implicit_grad.GetVal(x, y, z);
+        difference[c] = std::max(difference[c], std::abs(implicit_grad.GetVal(x, y, z) - explicit_grad.GetVal(x, y, z)));
+      }
+      conserved = conserved && std::abs(mass_after - mass_before) < 1e-10 * mass_before;
+    }
+  }
+  Check(conserved, "implicit diffusion conserves the public good");
+  const double ratio = difference[0] / difference[1];
+  Check(difference[0] < 1e-3 && ratio > 3.5 && ratio < 4.5,
+        "implicit diffusion departs from the explicit step by O(D^2)");
+}
+
+// The fused public good update against the original multi-pass one
+void TestFusedUpdate() {
+  Check(SameRuns({}, {{"FUSED_PUBLIC_GOOD_UPDATE", "0"}}), "fused update matches the multi-pass update");
+  Check(SameRuns({{"NUM_THREADS", "3"}}, {{"FUSED_PUBLIC_GOOD_UPDATE", "0"}, {"NUM_THREADS", "3"}}),
+        "fused update matches the multi-pass update (3 threads)");
+  Check(SameRuns({{"NUM_THREADS", "3"}}, {}), "fused update is the same on 3 threads as on 1");
+}
+
+// PUBLIC_GOOD_PRECISION float against double, plain and compensated. The
+// largest difference in the field, relative to the mean of the double
+// field, stays under 1e-5, the size of the errors accuracy.cc reports:
+// both with the population held fixed and over whole runs, whose cells
+// stay the same for this long
+void TestFloatPrecision() {
+  const auto relative_error = [](const Checkpoint & ref, const Checkpoint & test) {
+    double mean = 0, largest = 0;
+    for (size_t i = 0; i < ref.curr_field.size(); i++) {
+      mean += ref.curr_field[i];
+      largest = std::max(largest, std::abs(test.curr_field[i] - ref.curr_field[i]));
+    }
+    mean /= (double)ref.curr_field.size();
+    return mean > 0 ? largest / mean : largest;
+  };
+  const auto diffuse = [](PublicGoodsConfig & config) {
+    emp::Random random(config.SEED());
+    HCAWorld world(random);
+    world.SetShowProgress(false);
+    world.Setup(config);
+    world.UpdatePublicGood(30 * config.DIFFUSION_STEPS_PER_TIME_STEP());
+    return world.GetCheckpoint();
+  };
+
+  const size_t dims[][3] = {{40, 30, 1}, {20, 18, 12}};
+  for (const char * compensated : {"0", "1"}) {
+    bool diffusion_close = true, runs_close = true;
+    for (const auto & d : dims) {
+      PublicGoodsConfig double_config = MakeConfig(d[0], d[1], d[2], {});
+      PublicGoodsConfig float_config = MakeConfig(d[0], d[1], d[2], {{"PUBLIC_GOOD_PRECISION", "float"},
+                                                                     {"PUBLIC_GOOD_COMPENSATED", compensated}});
+      diffusion_close = diffusion_close && relative_error(diffuse(double_config), diffuse(float_config)) < 1e-5;
+      const Checkpoint double_run = RunWorld(double_config);
+      const Checkpoint float_run = RunWorld(float_config);
+      runs_close = runs_close && double_run.occupied == float_run.occupied
+                   && double_run.producer == float_run.producer && relative_error(double_run, float_run) < 1e-5;
+    }
+    const std::string name = std::string(compensated[0] == '1' ? "compensated " : "") + "float";
+    Check(diffusion_close, name + " public good diffuses like double");
+    Check(runs_close, name + " public good runs like double");
+  }
+}
+
+// Temporal blocking against one fused sweep per diffusion step, with a
+// block that does and does not divide DIFFUSION_STEPS_PER_TIME_STEP, and
+// BlockedUpdate() split into several row ranges as the threads split it,
+// on a plate and on a block
+void TestTemporalBlocking() {
+  Check(SameRuns({{"TEMPORAL_BLOCK_STEPS", "4"}}, {}), "temporal blocking matches unblocked steps");
+  Check(SameRuns({{"TEMPORAL_BLOCK_STEPS", "5"}, {"NUM_THREADS", "3"}}, {}),
+        "temporal blocking matches unblocked steps (3 threads)");
+
+  const size_t dims[][3] = {{37, 50, 1}, {17, 12, 6}};
+  std::mt19937_64 rng(5);
+  std::uniform_real_distribution<double> uniform(0, 0.1);
+  for (const auto & d : dims) {
+    const size_t size = d[0] * d[1] * d[2];
+    ResourceGradient blocked(d[0], d[1], d[2]);
+    blocked.SetDiffusionCoefficient(0.13);
+    std::vector<unsigned char> occupied(size), producer(size);
+    for (size_t i = 0; i < size; i++) {
+      occupied[i] = rng() % 3 == 0;
+      producer[i] = occupied[i] && rng() % 2;
+      blocked.SetVal(i % d[0], i / d[0] % d[1], i / (d[0] * d[1]), uniform(rng));
+      blocked.SetNextVal(i % d[0], i / d[0] % d[1], i / (d[0] * d[1]), uniform(rng));
+    }
+    const stencil::SourceTerms src = {occupied.data(), producer.data(), 0.1, 0.02, 0.05, 0.001};
+    ResourceGradient reference(blocked);
+
+    const size_t steps = 5;
+    reference.PrepareFusedUpdate();
+    for (size_t step = 0; step < steps; step++) {
+      reference.FusedUpdate(src, 0, reference.GetNumRows());
+      reference.FinishFusedUpdate();
+    }
+    const size_t num_rows = blocked.GetNumRows();
+    const size_t ranges = 4;
+    blocked.PrepareFusedUpdate();
+    for (size_t i = 0; i < ranges; i++) {
+      blocked.BlockedUpdate(src, steps, num_rows * i / ranges, num_rows * (i + 1) / ranges);
+    }
+    blocked.ResetSources(src, 0, num_rows);
+    blocked.FinishFusedUpdate();
+
+    bool same = SameGrid(blocked, reference, d[0], d[1], d[2]);
+    for (size_t i = 0; same && i < size; i++) {
+      same = SameBits(blocked.GetNextVal(i % d[0], i / d[0] % d[1], i / (d[0] * d[1])),
+                      reference.GetNextVal(i % d[0], i / d[0] % d[1], i / (d[0] * d[1])));
+    }
+    Check(same, "BlockedUpdate over " + std::to_string(ranges) + " row ranges matches FusedUpdate ("
+          + (d[2] == 1 ? "2D)" : "3D)"));
+  }
+}
+
+/// The open spots of @param cell_id in the order of the original CanDivide
+/// loop, which picked open_spots[GetUInt(0, open_spots.size())]
+std::vector<size_t> OpenSpotsReference(const OccupancyBitset & occupied, size_t cell_id,
+                                       int x_len, int y_len, int z_len) {
+  std::vector<size_t> open_spots;
+  const int x_coord = (int)(cell_id % (size_t)x_len);
+  const int y_coord = (int)((cell_id / (size_t)x_len) % (size_t)y_len);
+  const int z_coord = (int)((cell_id / (size_t)x_len) / (size_t)y_len);
+  for (int x = std::max(0, x_coord - 1); x < std::min(x_len, x_coord + 2); x++) {
+    for (int y = std::max(0, y_coord - 1); y < std::min(y_len, y_coord + 2); y++) {
+      for (int z = std::max(0, z_coord - 1); z < std::min(z_len, z_coord + 2); z++) {
+        const size_t this_cell = (size_t)(z * y_len * x_len + y * x_len + x);
+        if (!occupied.Test(this_cell)) open_spots.push_back(this_cell);
+      }
+    }
+  }
+  return open_spots;
+}
+
+// The table-driven CanDivide against the original loop: for every voxel,
+// corners, edges and faces included, on grids with axes of length 1 and 2,
+// the k-th open neighbor must be the k-th open spot of the loop, so that
+// the same random draw picks the same voxel
+void TestCanDivide() {
+  const size_t dims[][3] = {{1, 1, 1}, {5, 1, 1}, {1, 4, 1}, {2, 2, 2}, {7, 5, 1}, {6, 5, 4}, {3, 1, 5}, {70, 3, 3}};
+  std::mt19937_64 rng(9);
+  bool same = true;
+  for (const auto & d : dims) {
+    NeighborTable neighbors;
+    neighbors.Setup(d[0], d[1], d[2]);
+    const size_t size = d[0] * d[1] * d[2];
+    for (const unsigned density : {0u, 30u, 70u, 100u}) {
+      OccupancyBitset occupied;
+      occupied.Resize(size);
+      for (size_t i = 0; i < size; i++) {
+        if (rng() % 100 < density) occupied.Set(i);
+      }
+      for (size_t cell_id = 0; cell_id < size; cell_id++) {
+        const bool was_occupied = occupied.Test(cell_id);
+        occupied.Set(cell_id); // The dividing cell itself
+        const std::vector<size_t> reference = OpenSpotsReference(occupied, cell_id, (int)d[0], (int)d[1], (int)d[2]);
+        const uint32_t open = occupied.EmptyNeighbors(neighbors, cell_id);
+        same = same && OccupancyBitset::CountBits(open) == reference.size();
+        for (size_t k = 0; same && k < reference.size(); k++) {
+          same = neighbors.GetNeighbor(cell_id, OccupancyBitset::SelectBit(open, k)) == reference[k];
+        }
+        if (!was_occupied) occupied.Reset(cell_id);
+      }
+    }
+  }
+  Check(same, "CanDivide picks the same open neighbors as the original loop");
+}
+
+// The grid engine reproduces the emp::World one: same seed, same cells
+// and fields, on a plate and on a block, with and without threads for the
+// public good
+void TestGridEngine() {
+  const size_t dims[][3] = {{40, 30, 1}, {20, 18, 12}};
+  bool same = true;
+  for (const auto & d : dims) {
+    for (const char * threads : {"1", "3"}) {
+      PublicGoodsConfig config = MakeConfig(d[0], d[1], d[2], {{"NUM_THREADS", threads}});
+      same = same && SameCheckpoint(RunWorld<HCAGridWorld>(config), RunWorld<HCAWorld>(config));
+    }
+  }
+  Check(same, "HCAGridWorld matches HCAWorld");
+  PublicGoodsConfig fields_config = MakeConfig(20, 18, 6, {{"EXTRA_FIELDS", "drug:1:0.05:0.01:0:0.02:0.001"}});
+  Check(SameCheckpoint(RunWorld<HCAGridWorld>(fields_config), RunWorld<HCAWorld>(fields_config)),
+        "HCAGridWorld matches HCAWorld (EXTRA_FIELDS)");
+}
+
+// PARALLEL_CELL_UPDATE draws every voxel's random numbers from its own
+// stream and updates voxels of one colour at a time, so the number of
+// threads must not change the results
+void TestParallelCellUpdate() {
+  const size_t dims[][3] = {{40, 30, 1}, {20, 18, 12}};
+  bool same = true;
+  for (const auto & d : dims) {
+    PublicGoodsConfig config = MakeConfig(d[0], d[1], d[2], {{"PARALLEL_CELL_UPDATE", "1"}, {"NUM_THREADS", "1"}});
+    const Checkpoint serial = RunWorld<HCAGridWorld>(config);
+    for (const char * threads : {"2", "4"}) {
+      config.Set("NUM_THREADS", threads);
+      same = same && SameCheckpoint(RunWorld<HCAGridWorld>(config), serial);
+    }
+  }
+  Check(same, "PARALLEL_CELL_UPDATE gives the same results on 1, 2 and 4 threads");
+}
+
+// Pooled storage allocated on one thread and released on another, as
+// when the web interface sets a world up on the main thread and runs it on
+// its simulation thread
+void TestObjectPoolAcrossThreads() {
+  struct Probe { double vals[3]; };
+  using pool_t = ObjectPool<Probe, 64>;
+  const size_t count = 1000;
+
+  // Released here after the allocating thread has exited
+  std::vector<void *> blocks;
+  size_t live_on_thread = 0;
+  std::thread allocator([&blocks, &live_on_thread](){
+    for (size_t i = 0; i < count; i++) blocks.push_back(pool_t::Local().Allocate());
+    live_on_thread = pool_t::Local().GetNumLive();
+  });
+  allocator.join();
+  for (void * block : blocks) {
+    std::memset(block, 0xff, sizeof(Probe));
+    pool_t::Release(block);
+  }
+  Check(live_on_thread == count && pool_t::Local().GetNumLive() == 0,
+        "object pool counts blocks released after their thread exited");
+
+  // Released here while the allocating thread waits, then reused by it
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool allocated = false, released = false;
+  size_t reused = 0, live_after = 0;
+  blocks.clear();
+  std::thread owner([&](){
+    for (size_t i = 0; i < count; i++) blocks.push_back(pool_t::Local().Allocate());
+    std::unique_lock<std::mutex> lock(mutex);
+    allocated = true;
+    cv.notify_all();
+    cv.wait(lock, [&released](){return released;});
+    const std::set<void *> old_blocks(blocks.begin(), blocks.end());
+    for (size_t i = 0; i < count; i++) {
+      void * block = pool_t::Local().Allocate();
+      reused += old_blocks.count(block);
+      blocks[i] = block;
+    }
+    live_after = pool_t::Local().GetNumLive();
+    for (void * block : blocks) pool_t::Release(block);
+  });
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&allocated](){return allocated;});
+    for (void * block : blocks) pool_t::Release(block);
+    released = true;
+    cv.notify_all();
+  }
+  owner.join();
+  Check(reused == count && live_after == count && pool_t::Local().GetNumLive() == 0,
+        "object pool takes back blocks released on another thread");
+
+  // A whole world set up on one thread and run on another
+  PublicGoodsConfig config = MakeConfig(20, 18, 6, {});
+  const Checkpoint expected = RunWorld(config);
+  emp::Random random(config.SEED());
+  HCAWorld world(random);
+  world.SetShowProgress(false);
+  world.Setup(config);
+  std::thread runner([&world](){ world.Run(); });
+  runner.join();
+  Check(SameCheckpoint(world.GetCheckpoint(), expected), "world set up on one thread runs on another");
+}
+
+// A checkpoint read back from disk holds exactly what was written, and
+// runs continued from one match runs that were not interrupted
+void TestCheckpointRestart() {
+  PublicGoodsConfig config = MakeConfig(20, 18, 6, {{"EXTRA_FIELDS", "drug:1:0.05:0.01:0:0.02:0.001"}});
+  emp::Random random(config.SEED());
+  HCAWorld world(random);
+  world.SetShowProgress(false);
+  world.Setup(config);
+  for (size_t u = 0; u < 5; u++) world.RunStep();
+  const Checkpoint written = world.GetCheckpoint();
+  const std::string filename = (std::filesystem::temp_directory_path() / "hca_unit_tests_checkpoint.bin").string();
+  Checkpoint read;
+  const bool ok = written.Write(filename) && read.Read(filename);
+  Check(ok && SameCheckpoint(read, written) && read.random_state == written.random_state
+        && read.extra_fields == 1, "checkpoint reads back as written");
+
+  // A truncated file, and a header claiming an enormous grid, are turned
+  // away before any array is sized
+  const uint64_t file_size = (uint64_t)std::filesystem::file_size(filename);
+  std::filesystem::resize_file(filename, file_size - 1);
+  bool rejected = !Checkpoint().Read(filename);
+  const bool rewritten = written.Write(filename);
+  const uint64_t huge = uint64_t(1) << 40; // As the x and y lengths
+  FILE * file = std::fopen(filename.c_str(), "r+b");
+  const bool damaged = rewritten && file && std::fseek(file, (long)(sizeof(Checkpoint::MAGIC) + 4), SEEK_SET) == 0
+                       && std::fwrite(&huge, 8, 1, file) == 1 && std::fwrite(&huge, 8, 1, file) == 1;
+  if (file) std::fclose(file);
+  try {
+    rejected = rejected && damaged && !Checkpoint().Read(filename);
+  } catch (...) {
+    rejected = false;
+  }
+  std::remove(filename.c_str());
+  Check(rejected, "checkpoint reader rejects truncated and oversized files");
+
+  Check(SameCheckpoint(RunWithRestart(config, 12), RunWorld(config)), "HCAWorld run restarts exactly");
+  Check(SameCheckpoint(RunWithRestart<HCAGridWorld>(config, 12), RunWorld<HCAGridWorld>(config)),
+        "HCAGridWorld run restarts exactly");
+  PublicGoodsConfig parallel_config = MakeConfig(20, 18, 6, {{"PARALLEL_CELL_UPDATE", "1"}, {"NUM_THREADS", "3"}});
+  Check(SameCheckpoint(RunWithRestart<HCAGridWorld>(parallel_config, 12), RunWorld<HCAGridWorld>(parallel_config)),
+        "HCAGridWorld run restarts exactly (PARALLEL_CELL_UPDATE)");
+}
+
+// The last snapshot of a run with extra fields, read back plane by plane
+// and as whole volumes, holds all of the run's final grids; a damaged
+// chunk index is rejected instead of being read past
+void TestSnapshotReadBack() {
+  const std::string filename = (std::filesystem::temp_directory_path() / "hca_unit_tests_snapshot.bin").string();
+  std::remove(filename.c_str());
+  PublicGoodsConfig config = MakeConfig(20, 18, 6, {{"SNAPSHOT_FILE", filename}, {"SNAPSHOT_CHUNK_PLANES", "4"},
+                                                    {"DATA_RESOLUTION", "5"},
+                                                    {"EXTRA_FIELDS", "drug:1:0.05:0.01:0:0.02:0.001;signal:-1:0.1:0.05:0.01"}});
+  Checkpoint expected;
+  {
+    emp::Random random(config.SEED());
+    HCAWorld world(random);
+    world.SetShowProgress(false);
+    world.Setup(config);
+    while (world.GetUpdate() < 30) world.RunStep();
+    expected = world.GetCheckpoint();
+  }
+
+  snapshot::SnapshotReader reader;
+  const int frame = reader.Open(filename) ? reader.GetFrameID(30) : -1;
+  bool same = frame >= 0 && reader.GetNumFrames() == 6 && reader.GetFields().size() == 7
+              && reader.GetFieldID("drug") == 5 && reader.GetFieldID("signal") == 6;
+  const size_t plane = expected.x_len * expected.y_len;
+  for (size_t field = 0; same && field < reader.GetFields().size(); field++) {
+    const unsigned char * data = snapshot::CheckpointField(expected, field);
+    const size_t bytes = snapshot::TypeSize(reader.GetFields()[field].type);
+    std::vector<unsigned char> volume;
+    switch (bytes) {
+      case 1: {
+        std::vector<unsigned char> vals;
+        same = reader.ReadVolume((size_t)frame, field, vals);
+        volume.assign(vals.begin(), vals.end());
+        break;
+      }
+      case 4: {
+        std::vector<int32_t> vals;
+        same = reader.ReadVolume((size_t)frame, field, vals);
+        volume.resize(vals.size() * 4);
+        std::memcpy(volume.data(), vals.data(), volume.size());
+        break;
+      }
+      default: {
+        std::vector<double> vals;
+        same = reader.ReadVolume((size_t)frame, field, vals);
+        volume.resize(vals.size() * 8);
+        std::memcpy(volume.data(), vals.data(), volume.size());
+      }
+    }
+    same = same && volume.size() == expected.GetSize() * bytes
+           && std::memcmp(volume.data(), data, volume.size()) == 0;
+    for (size_t z = 0; same && z < expected.z_len && bytes == 8; z++) {
+      std::vector<double> slice;
+      same = reader.ReadSlice((size_t)frame, field, z, slice)
+             && std::memcmp(slice.data(), data + z * plane * 8, plane * 8) == 0;
+    }
+  }
+  Check(same, "snapshot reads back the run's grids");
+
+  // Claim that the first chunk is smaller than its planes
+  const uint64_t entry_offset = reader.GetFrameOffset(0) + 24 + offsetof(snapshot::ChunkEntry, stored_size);
+  reader.Close();
+  const uint64_t short_size = 8;
+  FILE * file = std::fopen(filename.c_str(), "r+b");
+  const bool damaged = file && std::fseek(file, (long)entry_offset, SEEK_SET) == 0
+                       && std::fwrite(&short_size, 8, 1, file) == 1;
+  if (file) std::fclose(file);
+  std::vector<double> vals;
+  Check(damaged && reader.Open(filename) && !reader.ReadVolume(0, 0, vals) && !reader.ReadSlice(0, 0, 1, vals),
+        "snapshot reader rejects a damaged chunk");
+  reader.Close();
+  std::remove(filename.c_str());
+}
+
+/// Contents of the file @param filename
+std::string ReadFile(const std::string & filename) {
+  std::ifstream in(filename, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// A run that is stopped after its checkpoint and restarted from it ends up
+// with the same population file as one that was not interrupted: the rows
+// from before the checkpoint are kept and the later ones replaced
+template <typename ENGINE>
+void TestPopulationFileRestart(const std::string & engine_name) {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path();
+  const std::string expected_file = (dir / "hca_unit_tests_population_expected.csv").string();
+  const std::string population_file = (dir / "hca_unit_tests_population.csv").string();
+  const std::string checkpoint_file = (dir / "hca_unit_tests_checkpoint.bin").string();
+  PublicGoodsConfig config = MakeConfig(20, 18, 6, {{"DATA_RESOLUTION", "5"}, {"POPULATION_FILE", expected_file}});
+  RunWorld<ENGINE>(config);
+
+  config.Set("POPULATION_FILE", population_file);
+  {
+    emp::Random random(config.SEED());
+    ENGINE world(random);
+    world.SetShowProgress(false);
+    world.Setup(config);
+    while (world.GetUpdate() < 15) world.RunStep();
+    world.GetCheckpoint().Write(checkpoint_file);
+    while (world.GetUpdate() < 22) world.RunStep(); // Rows written after the checkpoint
+  }
+  {
+    emp::Random random(config.SEED() + 1);
+    ENGINE world(random);
+    world.SetShowProgress(false);
+    world.Setup(config);
+    if (world.LoadCheckpoint(checkpoint_file)) world.Run();
+  }
+  const std::string expected = ReadFile(expected_file);
+  Check(expected.find("\n15,") != std::string::npos && ReadFile(population_file) == expected,
+        engine_name + " restart keeps the population file rows from before the checkpoint");
+  std::remove(expected_file.c_str());
+  std::remove(population_file.c_str());
+  std::remove(checkpoint_file.c_str());
+}
+
+// ACTIVE_REGION rebuilds its row tracking from the grids when a run is
+// restarted; with rows zeroed and skipped by then, the restarted run must
+// still match one that was not interrupted
+// ACTIVE_REGION at epsilon 0 only skips rows that are exactly zero, so it
+// matches a full update exactly, while the population fills the grid. Above 0 it zeroes rows that fall below
+// epsilon, and the field must stay within the difference that
+// ResourceGradient::TrackActiveRows() quotes
+void TestActiveRegion() {
+  Check(SameSparseRuns({{"ACTIVE_REGION", "1"}}, {}), "ACTIVE_REGION at epsilon 0 matches a full update");
+  Check(SameSparseRuns({{"ACTIVE_REGION", "1"}, {"NUM_THREADS", "3"}}, {}),
+        "ACTIVE_REGION at epsilon 0 matches a full update (3 threads)");
+
+  PublicGoodsConfig config = MakeConfig(40, 40, 20, {{"INIT_POP_SIZE", "5"}, {"ACTIVE_REGION", "1"},
+                                                     {"ACTIVE_REGION_EPSILON", "1e-12"}});
+  PublicGoodsConfig full_config = MakeConfig(40, 40, 20, {{"INIT_POP_SIZE", "5"}});
+  const Checkpoint active = RunWorld(config);
+  const Checkpoint full = RunWorld(full_config);
+  double largest = 0;
+  for (size_t i = 0; i < full.curr_field.size(); i++) {
+    largest = std::max(largest, std::abs(active.curr_field[i] - full.curr_field[i]));
+  }
+  Check(active.occupied == full.occupied && largest > 0 && largest <= 7.6e-12,
+        "ACTIVE_REGION at epsilon 1e-12 stays within the quoted difference");
+}
+
+void TestActiveRegionRestart() {
+  PublicGoodsConfig config = MakeConfig(40, 40, 16, {{"INIT_POP_SIZE", "10"}, {"TIME_STEPS", "20"},
+                                                     {"ACTIVE_REGION", "1"}, {"ACTIVE_REGION_EPSILON", "1e-4"}});
+  Check(SameCheckpoint(RunWithRestart(config, 10), RunWorld(config)), "ACTIVE_REGION run restarts exactly");
+}
+
+// Sweep files with bad values are turned away with an error, rather than
+// stopping the sweep partway with an exception
+void TestSweepFiles() {
+  const std::string filename = (std::filesystem::temp_directory_path() / "hca_unit_tests_sweep.txt").string();
+  const auto load = [&filename](const std::string & text) {
+    std::FILE * file = std::fopen(filename.c_str(), "w");
+    std::fputs(text.c_str(), file);
+    std::fclose(file);
+    PublicGoodsConfig config = MakeConfig(20, 20, 1, {});
+    SweepRunner sweep;
+    std::streambuf * cerr_buf = std::cerr.rdbuf(nullptr); // Errors are expected
+    bool loaded = false;
+    try {
+      loaded = sweep.Load(filename, config);
+    } catch (...) {
+      loaded = true;
+    }
+    std::cerr.rdbuf(cerr_buf);
+    return loaded;
+  };
+  Check(load("REPLICATES 3\nDRUG_CONCENTRATION 0.1 0.2\nKM 0.01\n"), "sweep grid loads");
+  Check(load("DRUG_CONCENTRATION,KM\n0.1,0.01\n0.2,1e-3\n"), "sweep list loads");
+  Check(!load("REPLICATES three\nDRUG_CONCENTRATION 0.1\n"), "sweep rejects a malformed REPLICATES");
+  Check(!load("REPLICATES 0\nDRUG_CONCENTRATION 0.1\n"), "sweep rejects zero REPLICATES");
+  Check(!load("DRUG_CONCENTRATION 0.1 high\n"), "sweep grid rejects a malformed value");
+  Check(!load("DRUG_CONCENTRATION,KM\n0.1,0.01\n0.2,x\n"), "sweep list rejects a malformed value");
+  Check(!load("NO_SUCH_SETTING 1\n"), "sweep rejects an unknown setting");
+  std::remove(filename.c_str());
+}
+
+// STEADY_STATE at epsilon 0 only freezes rows that do not change at all,
+// so it matches a full update exactly, with and without extra fields,
+// through rows freezing while empty and thawing as the population spreads
+void TestSteadyState() {
+  Check(SameSparseRuns({{"STEADY_STATE", "1"}}, {}), "STEADY_STATE at epsilon 0 matches a full update");
+  Check(SameSparseRuns({{"STEADY_STATE", "1"}, {"NUM_THREADS", "3"}}, {}),
+        "STEADY_STATE at epsilon 0 matches a full update (3 threads)");
+  const std::string fields = "drug:1:0.05:0.01:0:0.02:0.001;signal:-1:0.1:0.05:0.01";
+  Check(SameSparseRuns({{"STEADY_STATE", "1"}, {"EXTRA_FIELDS", fields}}, {{"EXTRA_FIELDS", fields}}),
+        "STEADY_STATE at epsilon 0 matches a full update (EXTRA_FIELDS)");
+}
+
+// STEADY_STATE with an epsilon above 0 freezes rows that still change a
+// little, so a restarted run only matches an uninterrupted one if it
+// carries on with the same rows frozen
+void TestSteadyStateRestart() {
+  PublicGoodsConfig config = MakeConfig(30, 30, 8, {{"INIT_POP_SIZE", "50"}, {"TIME_STEPS", "40"},
+                                                    {"DRUG_CONCENTRATION", "0.3"}, {"STEADY_STATE", "1"},
+                                                    {"STEADY_STATE_EPSILON", "1e-4"}});
+  const Checkpoint full = RunWorld(config);
+  size_t frozen = 0;
+  for (unsigned char row : full.steady_rows) frozen += (row >> 1) & 1; // See ResourceGradient::SaveSteadyRows()
+  Check(frozen > 0 && SameCheckpoint(RunWithRestart(config, 20), full), "STEADY_STATE run restarts exactly");
+}
+
+int main()
+{
+  Logger::Get().SetLevel(Logger::QUIET);
+
+  TestRowKernel<3, false, double>("double");
+  TestRowKernel<2, false, double>("double");
+  TestRowKernel<3, true, double>("double");
+  TestRowKernel<3, false, float>("float");
+  TestRowKernel<2, false, float>("float");
+  TestRowKernel<3, true, float>("float");
+  TestDiffuse();
+  TestLineSolver();
+  TestImplicitDiffusion();
+  TestFusedUpdate();
+  TestFloatPrecision();
+  TestTemporalBlocking();
+  TestCanDivide();
+  TestGridEngine();
+  TestParallelCellUpdate();
+  TestObjectPoolAcrossThreads();
+  TestCheckpointRestart();
+  TestPopulationFileRestart<HCAWorld>("HCAWorld");
+  TestPopulationFileRestart<HCAGridWorld>("HCAGridWorld");
+  TestActiveRegion();
+  TestActiveRegionRestart();
+  TestSteadyState();
+  TestSteadyStateRestart();
+  TestSnapshotReadBack();
+  TestSweepFiles();
+
+  std::cout << (failures ? std::to_string(failures) + " FAILED" : "all passed") << std::endl;
+  return (int)failures;
+}